@@ -4,6 +4,7 @@
 #include <spdlog/spdlog.h>
 #include "types.h"
 #include "node.h"
+#include "node_arena.h"
 #include "camera.h"
 #include "surface.h"
 #include "raytra_parser.h"
@@ -12,13 +13,16 @@
 #include "light.h"
 #include "bvh_node.h"
 #include "surface_list.h"
+#include "accelerator.h"
+#include "scene_options.h"
 
 using namespace RT::core;
 using namespace std;
 namespace po = boost::program_options;
 
 bool ParseArguments(int argc, char** argv, std::string* input_scene_name,
-    std::string* output_name, int* samples_per_pixel, int* shadow_samples) {
+    std::string* output_name, int* samples_per_pixel, int* shadow_samples,
+    bool* huge_pages) {
     po::options_description desc("options");
     try {
         desc.add_options()
@@ -34,7 +38,10 @@ bool ParseArguments(int argc, char** argv, std::string* input_scene_name,
                 "Samples per pixel")
             ("shadow_samples,d",
                 po::value(shadow_samples)->required(),
-                "Shadow Samples");
+                "Shadow Samples")
+            ("huge_pages",
+                po::bool_switch(huge_pages),
+                "Allocate scene nodes from huge pages");
 
         // parse arguments
         po::variables_map vm;
@@ -69,7 +76,9 @@ main(int argc, char** argv)
     string input_scene_name, output_name;
     int samples_per_pixel;
     int shadow_samples;
-    if (!ParseArguments(argc, argv, &input_scene_name, &output_name, &samples_per_pixel, &shadow_samples))
+    bool huge_pages = false;
+    if (!ParseArguments(argc, argv, &input_scene_name, &output_name, &samples_per_pixel,
+        &shadow_samples, &huge_pages))
         return -1;
 
     // parse and render raytra scene
@@ -77,20 +86,36 @@ main(int argc, char** argv)
     Surface::Ptr scene;
     vector<Light::Ptr> lights;
     Camera::Ptr camera;
-    if (!RaytraParser::ParseFile(input_scene_name, scene, lights, camera,
-        image_size, shadow_samples) || !scene || !camera || image_size[0] <= 0 ||
-        image_size[1] <= 0) {
-        spdlog::error("Failed to parse scene file.");
-        return -1;
+    SceneOptions options;
+    Accelerator::Ptr sc;
+    {
+        // nodes created while loading the scene live in one arena, released
+        // with the scene; nodes created while rendering use the heap
+        auto arena = NodeArena::Create(huge_pages);
+        NodeArena::Scope arena_scope(arena);
+        if (!RaytraParser::ParseFile(input_scene_name, scene, lights, camera,
+            image_size, options, shadow_samples) || !scene || !camera || image_size[0] <= 0 ||
+            image_size[1] <= 0) {
+            spdlog::error("Failed to parse scene file.");
+            return -1;
+        }
+
+        SurfaceList::Ptr list = dynamic_pointer_cast<SurfaceList>(scene);
+        if (options.HasFlag("benchmark_accel"))
+            Accelerator::Benchmark(list->GetSurfaces(), camera, image_size, options);
+        sc = Accelerator::CreateByType(options.GetString("accel", "bvh"), options);
+        sc->Build(list->GetSurfaces());
+        spdlog::info("Scene nodes: {} KB in {} arena block(s), {} on huge pages",
+            arena->GetAllocatedBytes() / 1024, arena->GetBlockCount(),
+            arena->GetHugeBlockCount());
     }
 
     // render scene
-    SurfaceList::Ptr list = dynamic_pointer_cast<SurfaceList>(scene);
-    BVHNode::Ptr root;
-    BVHNode::Ptr sc = root->BuildBVH(list->GetSurfaces());
 
     RayTracer rt;
     rt.SetNumSamplesPerPixel(samples_per_pixel);
+    rt.SetSampleDielectrics(options.GetString("dielectric", "split") == "sample");
+    rt.SetRouletteDepth(static_cast<uint>(max(0, options.GetInt("roulette_depth", 0))));
     rt.SetImageHeight(static_cast<uint>(image_size[1]));
     rt.Render(sc, lights, camera);
 
@@ -109,6 +109,41 @@ namespace RT {
         }
 
 
+        bool
+            AABB::Hit(const Ray& ray, Real tmin, Real tmax, Real& t_enter, Real& t_exit) const
+        {
+            if (!IsValid())
+                return false;
+
+            const Vec3r& origin = ray.GetOrigin();
+            const Vec3r& dir = ray.GetDirection();
+            for (int i = 0; i < 3; ++i) {
+                Real dir_inv = 1.0f / dir[i];
+                Real t0 = (min_[i] - origin[i]) * dir_inv;
+                Real t1 = (max_[i] - origin[i]) * dir_inv;
+                if (dir_inv < 0.0f)
+                    std::swap(t0, t1);
+                tmin = t0 > tmin ? t0 : tmin;
+                tmax = t1 < tmax ? t1 : tmax;
+                if (tmax < tmin)
+                    return false;
+            }
+            t_enter = tmin;
+            t_exit = tmax;
+            return true;
+        }
+
+
+        Real
+            AABB::GetSurfaceArea() const
+        {
+            if (!IsValid())
+                return 0;
+            Vec3r d = max_ - min_;
+            return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+        }
+
+
         AABB
             operator*(const Mat4r& xform, const AABB& bbox)
         {
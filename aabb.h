@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cmath>
 #include <limits>
+#include <utility>
 //#include <spdlog/spdlog.h>
 //#include <spdlog/fmt/bundled/ostream.h>
 #include "types.h"
@@ -10,6 +12,51 @@ namespace RT {
 
         class Ray;
 
+        // Round to float towards -infinity / +infinity, for storing
+        // conservative single-precision bounds
+        inline float RoundDown(Real x) {
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            if (x > std::numeric_limits<float>::max())
+                return std::numeric_limits<float>::max();
+            if (x < -std::numeric_limits<float>::max())
+                return -inf;
+            float f = static_cast<float>(x);
+            return f > x ? std::nextafter(f, -inf) : f;
+        }
+
+        inline float RoundUp(Real x) {
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            if (x > std::numeric_limits<float>::max())
+                return inf;
+            if (x < -std::numeric_limits<float>::max())
+                return -std::numeric_limits<float>::max();
+            float f = static_cast<float>(x);
+            return f < x ? std::nextafter(f, inf) : f;
+        }
+
+        // Relative error bound used to widen single-precision slab and
+        // sphere tests (a few float ulps)
+        static constexpr float kFloatGamma = 8 * std::numeric_limits<float>::epsilon();
+
+        // Ray prepared for conservative single-precision slab tests
+        // (\see AABB::SlabHitf). The rounding error of the float origin is
+        // turned into a per-axis widening of the slab intervals, so boxes
+        // are never missed because of the conversion.
+        struct SlabRayf {
+            float origin[3];   // origin rounded to float
+            float dir_inv[3];  // reciprocal direction
+            float t_pad[3];    // slab interval widening per axis
+
+            SlabRayf(const Vec3r& ray_origin, const Vec3r& ray_dir) {
+                for (int i = 0; i < 3; ++i) {
+                    origin[i] = static_cast<float>(ray_origin[i]);
+                    dir_inv[i] = static_cast<float>(1 / ray_dir[i]);
+                    Real delta = std::fabs(ray_origin[i] - origin[i]);
+                    t_pad[i] = delta > 0 ? RoundUp(std::fabs(delta / ray_dir[i])) : 0.0f;
+                }
+            }
+        };
+
         class AABB {
         public:
             EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -44,9 +91,58 @@ namespace RT {
             // Check if ray intersects with aabb
             bool Hit(const Ray& ray, Real tmin, Real tmax) const;
 
+            // Check if ray intersects with aabb and return the parametric
+            // range [t_enter, t_exit] of the ray inside the box
+            bool Hit(const Ray& ray, Real tmin, Real tmax, Real& t_enter, Real& t_exit) const;
+
+            // Get surface area of the box (0 if invalid)
+            Real GetSurfaceArea() const;
+
             // Use * operator to transform min and max coordinates by a matrix
             friend AABB operator*(const Mat4r& xform, const AABB& bbox);
 
+            // Slab test of a ray against a box given by its min/max corners,
+            // with the ray direction's reciprocal precomputed by the caller
+            // (for use in BVH traversal loops)
+            static inline bool SlabHit(const Vec3r& bmin, const Vec3r& bmax,
+                const Vec3r& origin, const Vec3r& dir_inv, Real tmin, Real tmax,
+                Real& t_enter) {
+                for (int i = 0; i < 3; ++i) {
+                    Real t0 = (bmin[i] - origin[i]) * dir_inv[i];
+                    Real t1 = (bmax[i] - origin[i]) * dir_inv[i];
+                    if (dir_inv[i] < 0.0f)
+                        std::swap(t0, t1);
+                    tmin = t0 > tmin ? t0 : tmin;
+                    tmax = t1 < tmax ? t1 : tmax;
+                    if (tmax < tmin)
+                        return false;
+                }
+                t_enter = tmin;
+                return true;
+            }
+
+            // Conservative single-precision slab test against a box stored
+            // as floats (rounded outwards); may report hits slightly outside
+            // the box but never misses one
+            static inline bool SlabHitf(const float bmin[3], const float bmax[3],
+                const SlabRayf& ray, float tmin, float tmax) {
+                for (int i = 0; i < 3; ++i) {
+                    float t0 = (bmin[i] - ray.origin[i]) * ray.dir_inv[i];
+                    float t1 = (bmax[i] - ray.origin[i]) * ray.dir_inv[i];
+                    if (ray.dir_inv[i] < 0.0f)
+                        std::swap(t0, t1);
+                    t0 -= ray.t_pad[i];
+                    t1 += ray.t_pad[i];
+                    t0 *= t0 > 0 ? 1 - kFloatGamma : 1 + kFloatGamma;
+                    t1 *= t1 > 0 ? 1 + kFloatGamma : 1 - kFloatGamma;
+                    tmin = t0 > tmin ? t0 : tmin;
+                    tmax = t1 < tmax ? t1 : tmax;
+                    if (tmax < tmin)
+                        return false;
+                }
+                return true;
+            }
+
         protected:
             Vec3r min_{ kInfinity, kInfinity, kInfinity };    //!< min coordinates
             Vec3r max_{ -kInfinity, -kInfinity, -kInfinity }; //!< max coordinates
@@ -0,0 +1,267 @@
+#include "accelerator.h"
+#include <chrono>
+#include <map>
+#include <spdlog/spdlog.h>
+#include "ray.h"
+#include "bvh_node.h"
+#include "compressed_bvh.h"
+#include "primitive_bvh.h"
+#include "trimesh.h"
+#include "sphere_batch.h"
+#include "uniform_grid.h"
+#include "kd_tree.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        Accelerator::Accelerator(const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "Accelerator";
+        }
+
+
+        bool
+            Accelerator::Build(const std::vector<Surface::Ptr>& surfaces)
+        {
+            unbounded_.clear();
+            vector<Surface::Ptr> bounded;
+            bounded.reserve(surfaces.size());
+            for (const auto& surface : surfaces) {
+                if (!surface)
+                    continue;
+                if (surface->IsBounded())
+                    bounded.push_back(surface);
+                else
+                    unbounded_.push_back(surface);
+            }
+            if (unbounded_.size())
+                spdlog::info("{}: {} unbounded surface(s) kept out of the structure",
+                    GetName(), unbounded_.size());
+            return BuildBounded(bounded) || unbounded_.size();
+        }
+
+
+        bool
+            Accelerator::BuildBounded(const std::vector<Surface::Ptr>&/*surfaces*/)
+        {
+            return false;
+        }
+
+
+        bool
+            Accelerator::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            // unbounded surfaces are cheap to test and their hits shorten
+            // the ray before traversal
+            bool had_hit = false;
+            for (const auto& surface : unbounded_) {
+                if (surface->Hit(ray, tmin, tmax, hit)) {
+                    tmax = hit.t;
+                    had_hit = true;
+                }
+            }
+            return HitBounded(ray, tmin, tmax, hit) || had_hit;
+        }
+
+
+        bool
+            Accelerator::HitBounded(const Ray&, Real, Real, RayHit&)
+        {
+            return false;
+        }
+
+
+        AABB
+            Accelerator::GetBoundingBox(bool /*force_recompute*/)
+        {
+            // bounds are fixed when the structure is built
+            return bbox_;
+        }
+
+
+        Accelerator::Ptr
+            Accelerator::CreateByType(const std::string& type, const SceneOptions& options)
+        {
+            if (type == "grid") {
+                auto grid = UniformGrid::Create();
+                grid->SetDensity(options.GetReal("grid_density", grid->GetDensity()));
+                grid->SetCompress(options.HasFlag("compress_bvh"));
+                return grid;
+            }
+            if (type == "kdtree") {
+                auto kd_tree = KdTree::Create();
+                kd_tree->SetIntersectCost(options.GetReal("kd_isect_cost",
+                    kd_tree->GetIntersectCost()));
+                kd_tree->SetMaxLeafSize(options.GetInt("kd_leaf_size",
+                    kd_tree->GetMaxLeafSize()));
+                kd_tree->SetCompress(options.HasFlag("compress_bvh"));
+                return kd_tree;
+            }
+            if (type != "bvh")
+                spdlog::warn("Accelerator: unknown type {} -- using bvh", type);
+            auto bvh = BVHAccelerator::Create();
+            bvh->SetCompress(options.HasFlag("compress_bvh"));
+            bvh->SetFlatten(options.GetString("flatten", bvh->GetFlatten()));
+            return bvh;
+        }
+
+
+        void
+            Accelerator::Benchmark(const std::vector<Surface::Ptr>& surfaces,
+                Camera::Ptr camera, const Vec2i& image_size, const SceneOptions& options)
+        {
+            if (!camera || image_size[0] <= 0 || image_size[1] <= 0)
+                return;
+
+            spdlog::info("Benchmarking accelerators ({} surfaces, {}x{} rays)",
+                surfaces.size(), image_size[0], image_size[1]);
+            Real xscale = 1.0 / image_size[0];
+            Real yscale = 1.0 / image_size[1];
+            for (const string type : { "bvh", "grid", "kdtree" }) {
+                // build
+                auto build_start = chrono::system_clock::now();
+                auto accelerator = CreateByType(type, options);
+                accelerator->Build(surfaces);
+                auto build_end = chrono::system_clock::now();
+
+                // trace one primary ray per pixel
+                size_t hits = 0;
+                Real t_sum = 0;
+                for (int y = 0; y < image_size[1]; ++y) {
+                    for (int x = 0; x < image_size[0]; ++x) {
+                        auto ray = camera->GetRay((x + .5) * xscale, (y + .5) * yscale);
+                        RayHit hit;
+                        if (accelerator->Hit(ray, kEpsilon, kInfinity, hit)) {
+                            ++hits;
+                            t_sum += hit.t;
+                        }
+                    }
+                }
+                auto trace_end = chrono::system_clock::now();
+
+                auto build_time = chrono::duration_cast<chrono::duration<double>>
+                    (build_end - build_start).count();
+                auto trace_time = chrono::duration_cast<chrono::duration<double>>
+                    (trace_end - build_end).count();
+                auto rays = static_cast<double>(image_size[0]) * image_size[1];
+                spdlog::info("{:>7}: build {:.3f}s, trace {:.3f}s ({:.2f} Mrays/s), "
+                    "{} hits (t sum {:.6g})", type, build_time, trace_time,
+                    trace_time > 0 ? rays / trace_time * 1e-6 : 0.0, hits, t_sum);
+            }
+        }
+
+
+        void
+            Accelerator::BuildMeshBVHs(const std::vector<Surface::Ptr>& surfaces,
+                const std::set<Surface*>& skip)
+        {
+            for (const auto& surface : surfaces) {
+                if (!surface || skip.count(surface.get()))
+                    continue;
+                auto trimesh = dynamic_pointer_cast<TriMesh>(surface);
+                if (trimesh && !trimesh->HasBVH())
+                    trimesh->BuildBVH();
+                auto sphere_batch = dynamic_pointer_cast<SphereBatch>(surface);
+                if (sphere_batch && !sphere_batch->HasBVH())
+                    sphere_batch->BuildBVH();
+            }
+        }
+
+
+        BVHAccelerator::BVHAccelerator(const std::string& name) :
+            Accelerator{}
+        {
+            name_ = name.size() ? name : "BVHAccelerator";
+        }
+
+
+        bool
+            BVHAccelerator::BuildBounded(const std::vector<Surface::Ptr>& surfaces)
+        {
+            if (flatten_ != "auto" && flatten_ != "on" && flatten_ != "off") {
+                spdlog::warn("BVHAccelerator: unknown flatten mode {} -- using auto", flatten_);
+                flatten_ = "auto";
+            }
+            if (compress_ && flatten_ == "on")
+                spdlog::warn("BVHAccelerator: compressed BVHs cannot be flattened");
+
+            // pick the meshes to flatten; a mesh whose geometry is used by
+            // several surfaces (or listed several times) is an instance and
+            // is only flattened if requested explicitly
+            set<Surface*> flattened;
+            if (!compress_ && flatten_ != "off") {
+                map<const void*, int> references;  // surfaces per geometry
+                for (const auto& surface : surfaces) {
+                    if (surface)
+                        ++references[surface->GetGeometryKey()];
+                }
+                size_t instanced = 0;
+                for (const auto& surface : surfaces) {
+                    if (!surface || surface->GetPrimitiveCount() <= 1)
+                        continue;
+                    if (flatten_ == "on" || references[surface->GetGeometryKey()] == 1)
+                        flattened.insert(surface.get());
+                    else
+                        ++instanced;
+                }
+                if (instanced) {
+                    spdlog::info("BVHAccelerator: {} instanced mesh surface(s) kept in their "
+                        "own BVHs (two-level), {} flattened", instanced, flattened.size());
+                }
+            }
+            BuildMeshBVHs(surfaces, flattened);
+
+            if (!flattened.empty()) {
+                // single tree over the faces of flattened meshes and all
+                // other surfaces
+                vector<PrimitiveRef> primitives;
+                set<Surface*> added;
+                for (const auto& surface : surfaces) {
+                    if (!surface)
+                        continue;
+                    if (!flattened.count(surface.get())) {
+                        primitives.push_back(PrimitiveRef{ surface.get(),
+                            PrimitiveBVH::kWholeSurface });
+                    }
+                    else if (added.insert(surface.get()).second) {
+                        auto count = surface->GetPrimitiveCount();
+                        for (size_t i = 0; i < count; ++i)
+                            primitives.push_back(PrimitiveRef{ surface.get(), static_cast<int>(i) });
+                    }
+                }
+                auto bvh = PrimitiveBVH::Create(GetName());
+                if (!bvh->Build(move(primitives), surfaces))
+                    bvh = nullptr;
+                root_ = bvh;
+
+                // flattened meshes only need their flat arrays from here on
+                for (const auto& surface : surfaces) {
+                    auto trimesh = dynamic_pointer_cast<TriMesh>(surface);
+                    if (trimesh && flattened.count(trimesh.get()))
+                        trimesh->ReleaseOpenMesh();
+                }
+            }
+            else {
+                root_ = BVHNode::BuildBVH(surfaces, GetName());
+                if (root_ && compress_)
+                    root_ = CompressedBVH::Build(root_, GetName());
+            }
+            bbox_.Reset();
+            if (root_)
+                bbox_ = root_->GetBoundingBox();
+            bound_dirty_ = false;
+            return root_ != nullptr;
+        }
+
+
+        bool
+            BVHAccelerator::HitBounded(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            return root_ && root_->Hit(ray, tmin, tmax, hit);
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "surface.h"
+#include "camera.h"
+#include "scene_options.h"
+
+namespace RT {
+    namespace core {
+
+        class Ray;
+        struct RayHit;
+
+        // Per-query record of the surfaces a ray was already tested against
+        // (mailboxing), for structures that reference a surface from several
+        // cells or leaves. A surface's Hit covers the whole ray range, so it
+        // never needs a second test; only the last kSize surfaces are kept,
+        // older repeats are simply tested again.
+        class SurfaceMailbox {
+        public:
+            static constexpr int kSize = 8;
+
+            SurfaceMailbox() { std::fill(ids_, ids_ + kSize, kNone); }
+
+            // Return whether surface was tested already; if not, record it
+            inline bool Contains(uint surface) {
+                for (int i = 0; i < kSize; ++i) {
+                    if (ids_[i] == surface)
+                        return true;
+                }
+                ids_[next_] = surface;
+                next_ = (next_ + 1) % kSize;
+                return false;
+            }
+        private:
+            static constexpr uint kNone = static_cast<uint>(-1);
+            uint ids_[kSize];  // recently tested surface indices
+            int next_{ 0 };    // slot to overwrite next
+        };
+
+        // Base class of the scene acceleration structures. An accelerator
+        // is built once over a list of surfaces and then answers closest-hit
+        // queries for the whole list through \see Surface::Hit.
+        class Accelerator : public Surface {
+        public:
+            RT_NODE(Accelerator)
+
+                explicit Accelerator(const std::string& name = std::string());
+
+            // Build the acceleration structure over the given surfaces.
+            // Unbounded surfaces (e.g. planes) are kept out of the structure
+            // and tested analytically on every ray.
+            // return Whether the structure was built
+            bool Build(const std::vector<Surface::Ptr>& surfaces);
+
+            bool Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit) override;
+
+            // Get bounding box of the bounded surfaces
+            AABB GetBoundingBox(bool force_recompute = false) override;
+
+            // Create an (unbuilt) accelerator by type name: "bvh", "grid" or
+            // "kdtree". Type-specific parameters are read from options.
+            // return Accelerator, or a BVH if type is unknown
+            static Accelerator::Ptr CreateByType(const std::string& type,
+                const SceneOptions& options);
+
+            // Build every accelerator type over the same surfaces and time
+            // its construction and one primary ray per pixel through camera
+            static void Benchmark(const std::vector<Surface::Ptr>& surfaces,
+                Camera::Ptr camera, const Vec2i& image_size, const SceneOptions& options);
+
+            // Store the scene tree in compressed (quantized) form
+            inline void SetCompress(bool compress) { compress_ = compress; }
+
+            inline bool GetCompress() const { return compress_; }
+        protected:
+            // Build the structure over the bounded surfaces
+            virtual bool BuildBounded(const std::vector<Surface::Ptr>& surfaces);
+
+            // Intersect ray with the bounded surfaces
+            virtual bool HitBounded(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit);
+
+            // Build the BVH of every mesh and sphere batch among surfaces that
+            // does not have one yet, except for the ones in skip (e.g.
+            // flattened meshes)
+            void BuildMeshBVHs(const std::vector<Surface::Ptr>& surfaces,
+                const std::set<Surface*>& skip = std::set<Surface*>());
+
+            std::vector<Surface::Ptr> unbounded_;  // surfaces tested outside the structure
+            bool compress_{ false };               // whether to compress BVHs
+        };
+
+        // Bounding volume hierarchy accelerator. Meshes are either flattened
+        // into a single \see PrimitiveBVH over all faces and surfaces, or kept
+        // as leaves with their own BVH (\see BVHNode, optionally stored as a
+        // \see CompressedBVH).
+        class BVHAccelerator : public Accelerator {
+        public:
+            RT_NODE(BVHAccelerator)
+
+                explicit BVHAccelerator(const std::string& name = std::string());
+
+            // Set how meshes are merged into the scene tree: "on" flattens
+            // every mesh, "off" keeps one BVH per mesh, and "auto" flattens
+            // meshes that are referenced only once (instanced meshes keep
+            // their own BVH and are shared)
+            inline void SetFlatten(const std::string& flatten) { flatten_ = flatten; }
+
+            inline const std::string& GetFlatten() const { return flatten_; }
+        protected:
+            bool BuildBounded(const std::vector<Surface::Ptr>& surfaces) override;
+
+            bool HitBounded(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            Surface::Ptr root_;              // tree root
+            std::string flatten_{ "auto" };  // mesh flattening mode
+        };
+
+    }  // namespace core
+}  // namespace RT
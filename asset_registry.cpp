@@ -0,0 +1,79 @@
+#include "asset_registry.h"
+#include <spdlog/spdlog.h>
+#include "file_hash.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+        namespace fs = boost::filesystem;
+
+        bool
+            AssetRegistry::GetContentKey(const fs::path& filepath, ContentKey& key)
+        {
+            boost::system::error_code ec;
+            fs::path canonical = fs::canonical(filepath, ec);
+            if (ec)
+                return false;
+            auto it = path_keys_.find(canonical);
+            if (it != path_keys_.end()) {
+                key = it->second;
+                return true;
+            }
+            uint64_t size = fs::file_size(canonical, ec);
+            uint64_t hash;
+            if (ec || !HashFile(canonical, hash))
+                return false;
+            key = ContentKey{ size, hash };
+            path_keys_[canonical] = key;
+            return true;
+        }
+
+
+        ImageTexture::Ptr
+            AssetRegistry::GetImageTexture(const fs::path& filepath, bool flipx, bool flipy)
+        {
+            ContentKey key;
+            if (!GetContentKey(filepath, key)) {
+                // unreadable: let the texture report the error when it loads
+                return ImageTexture::Create(filepath, flipx, flipy);
+            }
+            auto& texture = textures_[{ key, (flipx ? 1 : 0) | (flipy ? 2 : 0) }];
+            if (texture) {
+                ++shared_count_;
+                spdlog::info("AssetRegistry: sharing texture {} with {}",
+                    filepath.filename().string(), texture->GetImagePath().filename().string());
+                return texture;
+            }
+            texture = ImageTexture::Create(filepath, flipx, flipy);
+            return texture;
+        }
+
+
+        TriMesh::Ptr
+            AssetRegistry::GetTriMesh(const fs::path& filepath, bool reorder, bool use_cache)
+        {
+            ContentKey key;
+            bool has_key = GetContentKey(filepath, key);
+            if (has_key) {
+                auto it = meshes_.find({ key, reorder });
+                if (it != meshes_.end()) {
+                    ++shared_count_;
+                    spdlog::info("AssetRegistry: sharing mesh {} with {}",
+                        filepath.filename().string(),
+                        it->second->GetFilePath().filename().string());
+                    auto mesh = TriMesh::Create();
+                    mesh->ShareGeometry(it->second);
+                    return mesh;
+                }
+            }
+            auto mesh = TriMesh::Create();
+            if (!mesh->Load(filepath, reorder, use_cache))
+                return nullptr;
+            if (has_key)
+                meshes_[{ key, reorder }] = mesh;
+            return mesh;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <boost/filesystem.hpp>
+#include "trimesh.h"
+#include "image_texture.h"
+
+namespace RT {
+    namespace core {
+
+        // Registry of the meshes and textures loaded while parsing a scene.
+        // Assets are keyed by file content (size and hash), so a file that
+        // is referenced several times, or copied under another name, is
+        // read once: textures are shared, and every mesh surface gets its
+        // own TriMesh (for its material) viewing the same read-only geometry.
+        class AssetRegistry {
+        public:
+            // Get a texture for the image file, shared with earlier requests
+            // for the same content and flips
+            ImageTexture::Ptr GetImageTexture(const boost::filesystem::path& filepath,
+                bool flipx, bool flipy);
+
+            // Get a new mesh surface for the mesh file, sharing the geometry
+            // of an earlier mesh with the same content; otherwise the mesh is
+            // loaded (\see TriMesh::Load). Returns null if it cannot be loaded.
+            TriMesh::Ptr GetTriMesh(const boost::filesystem::path& filepath,
+                bool reorder = true, bool use_cache = true);
+
+            // Get number of requests served from already loaded assets
+            inline size_t GetSharedCount() const { return shared_count_; }
+        protected:
+            using ContentKey = std::pair<uint64_t, uint64_t>;  // file size and hash
+
+            // Get content key of a file (hashing each distinct path once)
+            bool GetContentKey(const boost::filesystem::path& filepath, ContentKey& key);
+
+            std::map<boost::filesystem::path, ContentKey> path_keys_;  // known paths
+            std::map<std::pair<ContentKey, int>, ImageTexture::Ptr> textures_;  // by flips
+            std::map<std::pair<ContentKey, bool>, TriMesh::Ptr> meshes_;  // by reorder
+            size_t shared_count_{ 0 };  // requests served from loaded assets
+        };
+
+    }  // namespace core
+}  // namespace RT
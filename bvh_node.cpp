@@ -34,30 +34,17 @@ namespace RT {
 
 
         bool
-            BVHNode::Hit(const Ray& ray, Real tmin, Real tmax, HitRecord& hit_record)
+            BVHNode::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
         {
-            if (bbox_.Hit(ray, tmin, tmax)) {
-                HitRecord lrec, rrec;
-                bool left_hit = (left_ != nullptr) and (left_->Hit(ray, tmin, tmax, lrec));
-                bool right_hit = (right_ != nullptr) and (right_->Hit(ray, tmin, tmax, rrec));
-                if (left_hit and right_hit) {
-                    if (lrec.GetRayT() < rrec.GetRayT())
-                        hit_record = lrec;
-                    else
-                        hit_record = rrec;
-                    return true;
-                }
-                else if (left_hit) {
-                    hit_record = lrec;
-                    return true;
-                }
-                else if (right_hit)
-                {
-                    hit_record = rrec;
-                    return true;
-                }
-            }
-            return false;
+            if (!bbox_.Hit(ray, tmin, tmax))
+                return false;
+            // surfaces only write hit on a hit, so the right child
+            // can search below the left hit without copying records
+            bool left_hit = left_ != nullptr && left_->Hit(ray, tmin, tmax, hit);
+            if (left_hit)
+                tmax = hit.t;
+            bool right_hit = right_ != nullptr && right_->Hit(ray, tmin, tmax, hit);
+            return left_hit || right_hit;
         }
 
         BVHNode::Ptr
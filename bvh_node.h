@@ -10,7 +10,7 @@ namespace RT {
     namespace core {
 
         class Ray;
-        class HitRecord;
+        struct RayHit;
         class Material;
 
         class BVHNode : public Surface {
@@ -19,7 +19,7 @@ namespace RT {
 
                 explicit BVHNode(const std::string& name = std::string());
 
-            bool Hit(const Ray& ray, Real tmin, Real tmax, HitRecord& hit_record) override;
+            bool Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit) override;
             AABB GetBoundingBox(bool force_recompute = false) override;
             static BVHNode::Ptr BuildBVH(std::vector<Surface::Ptr> surfaces,
                 const std::string& name = std::string());
@@ -27,6 +27,12 @@ namespace RT {
             // function to combine bboxes
             static AABB BBoxCombine(const AABB& left, const AABB& right);
 
+            // Get left child
+            inline Surface::Ptr GetLeft() const { return left_; }
+
+            // Get right child (null for single-surface leaves)
+            inline Surface::Ptr GetRight() const { return right_; }
+
         protected:
             // Build a BVH (sub)tree from the input list of surface in
             //       the specified range.
@@ -41,6 +41,12 @@ namespace RT {
 
             Real GetAspectRatio() const { return aspect_; }
 
+            // Get angle (radians) subtended by one pixel of an image with
+            // the given height, e.g. the spread of primary ray cones
+            Real GetPixelSpread(uint image_height) const {
+                return image_height ? vertical_.norm() / image_height : 0;
+            }
+
             void UpdateViewport();
         protected:
             Vec3r eye_{ 0, 0, 0 };                      // eye location
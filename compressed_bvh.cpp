@@ -0,0 +1,233 @@
+#include "compressed_bvh.h"
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include "ray.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        namespace {
+
+            // relative padding applied when dequantizing so that rounding
+            // errors can never shrink a box
+            constexpr Real kQuantizePad = 64 * std::numeric_limits<Real>::epsilon();
+
+        }  // namespace
+
+
+        CompressedBVH::CompressedBVH(const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "CompressedBVH";
+        }
+
+
+        AABB
+            CompressedBVH::GetBoundingBox(bool /*force_recompute*/)
+        {
+            // bounds are fixed when the compressed tree is built
+            return bbox_;
+        }
+
+
+        void
+            CompressedBVH::Quantize(const Vec3r& parent_min, const Vec3r& parent_max,
+                const AABB& child_box, uchar qmin[3], uchar qmax[3])
+        {
+            const Vec3r& child_min = child_box.GetMin();
+            const Vec3r& child_max = child_box.GetMax();
+            for (int i = 0; i < 3; ++i) {
+                Real extent = parent_max[i] - parent_min[i];
+                if (!(extent > 0)) {
+                    qmin[i] = 0;
+                    qmax[i] = 255;
+                    continue;
+                }
+                Real scale = extent / 255;
+                Real lo = floor((child_min[i] - parent_min[i]) / scale);
+                Real hi = ceil((child_max[i] - parent_min[i]) / scale);
+                qmin[i] = static_cast<uchar>(CLAMP(lo, 0, 255));
+                qmax[i] = static_cast<uchar>(CLAMP(hi, 0, 255));
+            }
+
+            // make sure the dequantized box contains the child box, stepping
+            // the quantized coordinates outward if rounding got in the way
+            Vec3r dmin, dmax;
+            Dequantize(parent_min, parent_max, qmin, qmax, dmin, dmax);
+            for (int i = 0; i < 3; ++i) {
+                if (dmin[i] > child_min[i] && qmin[i] > 0)
+                    --qmin[i];
+                if (dmax[i] < child_max[i] && qmax[i] < 255)
+                    ++qmax[i];
+            }
+        }
+
+
+        void
+            CompressedBVH::Dequantize(const Vec3r& parent_min, const Vec3r& parent_max,
+                const uchar qmin[3], const uchar qmax[3], Vec3r& child_min, Vec3r& child_max)
+        {
+            for (int i = 0; i < 3; ++i) {
+                Real extent = parent_max[i] - parent_min[i];
+                Real scale = extent / 255;
+                Real pad = (fabs(parent_min[i]) + fabs(parent_max[i])) * kQuantizePad;
+                child_min[i] = parent_min[i] + qmin[i] * scale - pad;
+                child_max[i] = (qmax[i] == 255 ? parent_max[i] :
+                    parent_min[i] + qmax[i] * scale) + pad;
+            }
+        }
+
+
+        uint
+            CompressedBVH::Flatten(BVHNode::Ptr node, const Vec3r& node_min,
+                const Vec3r& node_max, int depth)
+        {
+            auto index = static_cast<uint>(nodes_.size());
+            nodes_.push_back(CompressedBVHNode{});
+
+            Surface::Ptr children[2] = { node->GetLeft(), node->GetRight() };
+            for (int c = 0; c < 2; ++c) {
+                // note: nodes_ may be reallocated by the recursion below, so
+                // always index into it rather than holding a reference
+                AABB child_box;
+                if (children[c])
+                    child_box = children[c]->GetBoundingBox();
+                if (!child_box.IsValid()) {
+                    nodes_[index].child[c] = kEmptyChild;
+                    continue;
+                }
+
+                // quantize child bounds relative to this node
+                uchar qmin[3], qmax[3];
+                Quantize(node_min, node_max, child_box, qmin, qmax);
+                for (int i = 0; i < 3; ++i) {
+                    nodes_[index].qmin[c][i] = qmin[i];
+                    nodes_[index].qmax[c][i] = qmax[i];
+                }
+
+                // children are quantized against the box the traversal will
+                // reconstruct, not the exact box
+                Vec3r child_min, child_max;
+                Dequantize(node_min, node_max, qmin, qmax, child_min, child_max);
+                auto child_bvh = dynamic_pointer_cast<BVHNode>(children[c]);
+                uint child_ref;
+                if (child_bvh && depth + 2 < kMaxStackDepth) {
+                    child_ref = Flatten(child_bvh, child_min, child_max, depth + 1);
+                }
+                else {
+                    // too deep for the traversal stack: keep the (uncompressed)
+                    // subtree as a primitive
+                    child_ref = kLeafFlag | static_cast<uint>(primitives_.size());
+                    primitives_.push_back(children[c]);
+                }
+                nodes_[index].child[c] = child_ref;
+            }
+            return index;
+        }
+
+
+        CompressedBVH::Ptr
+            CompressedBVH::Build(Surface::Ptr bvh_root, const std::string& name)
+        {
+            auto cbvh = CompressedBVH::Create(name);
+            if (!bvh_root)
+                return cbvh;
+
+            // the root is always a BVHNode so that node 0 has children
+            auto root = dynamic_pointer_cast<BVHNode>(bvh_root);
+            if (!root)
+                root = BVHNode::BuildBVH(vector<Surface::Ptr>{ bvh_root }, name);
+
+            cbvh->bbox_ = root->GetBoundingBox();
+            cbvh->bound_dirty_ = false;
+            if (!cbvh->bbox_.IsValid())
+                return cbvh;
+            cbvh->Flatten(root, cbvh->bbox_.GetMin(), cbvh->bbox_.GetMax(), 0);
+            cbvh->nodes_.shrink_to_fit();
+            cbvh->primitives_.shrink_to_fit();
+
+            spdlog::info("Compressed BVH ({}): {} nodes ({} KB), {} primitives",
+                cbvh->GetName(), cbvh->GetNodeCount(), cbvh->GetNodeMemory() / 1024,
+                cbvh->GetPrimitiveCount());
+            return cbvh;
+        }
+
+
+        bool
+            CompressedBVH::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            if (nodes_.empty())
+                return false;
+
+            const Vec3r origin = ray.GetOrigin();
+            const Vec3r dir = ray.GetDirection();
+            const Vec3r dir_inv{ 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+
+            // each stack entry carries its node's dequantized box, which is
+            // needed to decode the node's children
+            struct StackEntry {
+                uint node;
+                Real t;
+                Vec3r min;
+                Vec3r max;
+            };
+            StackEntry stack[kMaxStackDepth];
+            int top = 0;
+
+            Real root_t;
+            if (!AABB::SlabHit(bbox_.GetMin(), bbox_.GetMax(), origin, dir_inv, tmin, tmax, root_t))
+                return false;
+            stack[top++] = StackEntry{ 0, root_t, bbox_.GetMin(), bbox_.GetMax() };
+
+            bool had_hit = false;
+            Real closest = tmax;
+            while (top) {
+                const StackEntry entry = stack[--top];
+                if (entry.t > closest)
+                    continue;
+
+                // decode and test both children
+                const auto& node = nodes_[entry.node];
+                Vec3r child_min[2], child_max[2];
+                Real child_t[2]{ 0, 0 };
+                bool child_hit[2]{ false, false };
+                for (int c = 0; c < 2; ++c) {
+                    if (node.child[c] == kEmptyChild)
+                        continue;
+                    Dequantize(entry.min, entry.max, node.qmin[c], node.qmax[c],
+                        child_min[c], child_max[c]);
+                    child_hit[c] = AABB::SlabHit(child_min[c], child_max[c], origin, dir_inv,
+                        tmin, closest, child_t[c]);
+                }
+
+                // visit the nearer child first
+                int first = (child_hit[1] && (!child_hit[0] || child_t[1] < child_t[0])) ? 1 : 0;
+                int order[2] = { first, 1 - first };
+
+                // intersect leaves right away (shrinking closest)
+                for (int c : order) {
+                    if (!child_hit[c] || !(node.child[c] & kLeafFlag))
+                        continue;
+                    const auto& primitive = primitives_[node.child[c] & ~kLeafFlag];
+                    if (primitive->Hit(ray, tmin, closest, hit)) {
+                        closest = hit.t;
+                        had_hit = true;
+                    }
+                }
+
+                // push inner children, far one first so the near one pops first
+                for (int k = 1; k >= 0; --k) {
+                    int c = order[k];
+                    if (!child_hit[c] || (node.child[c] & kLeafFlag) || child_t[c] > closest)
+                        continue;
+                    stack[top++] = StackEntry{ node.child[c], child_t[c], child_min[c],
+                        child_max[c] };
+                }
+            }
+            return had_hit;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,73 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "surface.h"
+#include "bvh_node.h"
+
+namespace RT {
+    namespace core {
+
+        class Ray;
+        struct RayHit;
+
+        // Compressed BVH node. Each node stores the bounds of its two children
+        // as 8-bit offsets relative to its own (dequantized) box, so a node is
+        // 20 bytes instead of a full BVHNode with two 48-byte AABBs.
+        struct CompressedBVHNode {
+            uchar qmin[2][3];   // quantized child min coordinates
+            uchar qmax[2][3];   // quantized child max coordinates
+            uint child[2];      // child node index, leaf primitive index, or kEmptyChild
+        };
+
+        class CompressedBVH : public Surface {
+        public:
+            RT_NODE(CompressedBVH)
+
+                explicit CompressedBVH(const std::string& name = std::string());
+
+            bool Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit) override;
+
+            AABB GetBoundingBox(bool force_recompute = false) override;
+
+            // Build a compressed BVH from an existing BVH (sub)tree. The
+            // non-BVHNode surfaces of the tree become the primitives of the
+            // compressed BVH.
+            static CompressedBVH::Ptr Build(Surface::Ptr bvh_root,
+                const std::string& name = std::string());
+
+            // Get number of nodes
+            inline size_t GetNodeCount() const { return nodes_.size(); }
+
+            // Get number of primitives referenced by the leaves
+            inline size_t GetPrimitiveCount() const { return primitives_.size(); }
+
+            // Get memory used by the nodes (in bytes)
+            inline size_t GetNodeMemory() const { return nodes_.size() * sizeof(CompressedBVHNode); }
+
+            // Dequantize a child box relative to its parent's box. The returned
+            // box always contains the original (unquantized) child box.
+            static void Dequantize(const Vec3r& parent_min, const Vec3r& parent_max,
+                const uchar qmin[3], const uchar qmax[3], Vec3r& child_min, Vec3r& child_max);
+
+            static constexpr uint kEmptyChild = 0xffffffff;   // no child
+            static constexpr uint kLeafFlag = 0x80000000;     // child is a primitive
+            static constexpr int kMaxStackDepth = 64;         // traversal stack size
+        protected:
+            // Flatten a BVHNode subtree into nodes_; the node's box
+            // (node_min/node_max) must be the dequantized box the traversal
+            // will see
+            uint Flatten(BVHNode::Ptr node, const Vec3r& node_min, const Vec3r& node_max,
+                int depth);
+
+            // Quantize a child box relative to its parent's box (conservatively)
+            static void Quantize(const Vec3r& parent_min, const Vec3r& parent_max,
+                const AABB& child_box, uchar qmin[3], uchar qmax[3]);
+
+            std::vector<CompressedBVHNode> nodes_;  // flattened nodes (root is nodes_[0])
+            std::vector<Surface::Ptr> primitives_;  // leaf surfaces
+        private:
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace RT {
+    namespace core {
+
+        // 64-bit hash of a file's contents (FNV-1a style, 8 bytes per
+        // step), used to recognize unchanged or identical files
+        // return Whether the file could be read
+        inline bool HashFile(const boost::filesystem::path& filepath, uint64_t& hash)
+        {
+            boost::iostreams::mapped_file_source file;
+            try {
+                file.open(filepath.string());
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+            const unsigned char* data = reinterpret_cast<const unsigned char*>(file.data());
+            const size_t size = file.size();
+            const uint64_t kPrime = 0x100000001b3ULL;
+            uint64_t h = 0xcbf29ce484222325ULL ^ size;
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                h = (h ^ word) * kPrime;
+                h ^= h >> 29;
+            }
+            for (; i < size; ++i)
+                h = (h ^ data[i]) * kPrime;
+            hash = h ^ (h >> 32);
+            return true;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,466 @@
+#include "flat_mesh.h"
+#include <algorithm>
+#include "morton.h"
+#include "parallel.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        FlatMesh::FlatMesh(const FlatMesh& other)
+        {
+            *this = other;
+        }
+
+
+        FlatMesh&
+            FlatMesh::operator=(const FlatMesh& other)
+        {
+            if (this == &other)
+                return *this;
+            positions_ = other.positions_;
+            indices_ = other.indices_;
+            normals_ = other.normals_;
+            texcoords_ = other.texcoords_;
+            storage_ = other.storage_;
+            quantized_ = other.quantized_;
+            if (IsMapped()) {
+                // share the mapped arrays
+                vertex_count_ = other.vertex_count_;
+                face_count_ = other.face_count_;
+                position_data_ = other.position_data_;
+                index_data_ = other.index_data_;
+                normal_data_ = other.normal_data_;
+                texcoord_data_ = other.texcoord_data_;
+            }
+            else {
+                UpdateViews();
+            }
+            return *this;
+        }
+
+
+        FlatMesh::FlatMesh(FlatMesh&& other) noexcept
+        {
+            *this = move(other);
+        }
+
+
+        FlatMesh&
+            FlatMesh::operator=(FlatMesh&& other) noexcept
+        {
+            if (this == &other)
+                return *this;
+            // moved vectors keep their buffers, so the views stay valid
+            positions_ = move(other.positions_);
+            indices_ = move(other.indices_);
+            normals_ = move(other.normals_);
+            texcoords_ = move(other.texcoords_);
+            storage_ = move(other.storage_);
+            quantized_ = move(other.quantized_);
+            vertex_count_ = other.vertex_count_;
+            face_count_ = other.face_count_;
+            position_data_ = other.position_data_;
+            index_data_ = other.index_data_;
+            normal_data_ = other.normal_data_;
+            texcoord_data_ = other.texcoord_data_;
+            other.Clear();
+            return *this;
+        }
+
+
+        void
+            FlatMesh::Resize(size_t vertex_count, size_t face_count, bool normals,
+                bool texcoords)
+        {
+            storage_ = nullptr;
+            positions_.assign(3 * vertex_count, 0.0f);
+            indices_.assign(3 * face_count, 0);
+            normals_.assign(normals ? 3 * vertex_count : 0, 0.0f);
+            texcoords_.assign(texcoords ? 2 * vertex_count : 0, 0.0f);
+            quantized_ = nullptr;
+            UpdateViews();
+        }
+
+
+        void
+            FlatMesh::Clear()
+        {
+            // swap with empty vectors to actually release memory
+            vector<float>().swap(positions_);
+            vector<uint>().swap(indices_);
+            vector<float>().swap(normals_);
+            vector<float>().swap(texcoords_);
+            storage_ = nullptr;
+            quantized_ = nullptr;
+            UpdateViews();
+        }
+
+
+        void
+            FlatMesh::Map(std::shared_ptr<const void> storage, size_t vertex_count,
+                size_t face_count, const float* positions, const uint* indices,
+                const float* normals, const float* texcoords)
+        {
+            Clear();
+            storage_ = move(storage);
+            vertex_count_ = vertex_count;
+            face_count_ = face_count;
+            position_data_ = positions;
+            index_data_ = indices;
+            normal_data_ = normals;
+            texcoord_data_ = texcoords;
+        }
+
+
+        void
+            FlatMesh::MakeOwned()
+        {
+            if (!IsMapped() && !IsQuantized())
+                return;
+            if (IsMapped())
+                indices_.assign(index_data_, index_data_ + 3 * face_count_);
+            if (IsQuantized()) {
+                const size_t vertex_count = vertex_count_;
+                const bool normals = HasNormals();
+                const bool texcoords = HasTexCoords();
+                positions_.resize(3 * vertex_count);
+                normals_.resize(normals ? 3 * vertex_count : 0);
+                texcoords_.resize(texcoords ? 2 * vertex_count : 0);
+                ParallelFor(vertex_count, [&](size_t begin, size_t end, size_t) {
+                    for (size_t v = begin; v < end; ++v) {
+                        SetPosition(v, GetPosition(v));
+                        if (normals)
+                            SetNormal(v, GetNormal(v));
+                        if (texcoords)
+                            SetTexCoord(v, GetTexCoord(v));
+                    }
+                }, kMinQuantizeVertices);
+            }
+            else {
+                positions_.assign(position_data_, position_data_ + 3 * vertex_count_);
+                if (normal_data_)
+                    normals_.assign(normal_data_, normal_data_ + 3 * vertex_count_);
+                if (texcoord_data_)
+                    texcoords_.assign(texcoord_data_, texcoord_data_ + 2 * vertex_count_);
+            }
+            storage_ = nullptr;
+            quantized_ = nullptr;
+            UpdateViews();
+        }
+
+
+        void
+            FlatMesh::Quantize()
+        {
+            if (IsQuantized() || IsEmpty())
+                return;
+            const size_t vertex_count = GetVertexCount();
+            const bool normals = HasNormals();
+            const bool texcoords = HasTexCoords();
+            auto quantized = make_shared<QuantizedArrays>();
+            AABB bbox = GetBoundingBox();
+            for (int i = 0; i < 3; ++i) {
+                quantized->origin[i] = static_cast<float>(bbox.GetMin()[i]);
+                quantized->scale[i] = static_cast<float>(
+                    (bbox.GetMax()[i] - bbox.GetMin()[i]) / 65535);
+            }
+            quantized->positions.resize(3 * vertex_count);
+            quantized->normals.resize(normals ? 2 * vertex_count : 0);
+            quantized->texcoords.resize(texcoords ? 2 * vertex_count : 0);
+            ParallelFor(vertex_count, [&](size_t begin, size_t end, size_t) {
+                for (size_t v = begin; v < end; ++v) {
+                    Vec3r p = GetPosition(v);
+                    for (int i = 0; i < 3; ++i) {
+                        float step = quantized->scale[i] > 0 ?
+                            (static_cast<float>(p[i]) - quantized->origin[i]) / quantized->scale[i] : 0;
+                        quantized->positions[3 * v + i] =
+                            static_cast<uint16_t>(lround(CLAMP(step, 0.0f, 65535.0f)));
+                    }
+                    if (normals)
+                        OctEncode(GetNormal(v).cast<float>(), &quantized->normals[2 * v]);
+                    if (texcoords) {
+                        Vec2r uv = GetTexCoord(v);
+                        quantized->texcoords[2 * v] = FloatToHalf(static_cast<float>(uv[0]));
+                        quantized->texcoords[2 * v + 1] = FloatToHalf(static_cast<float>(uv[1]));
+                    }
+                }
+            }, kMinQuantizeVertices);
+
+            // keep the indices, drop the float attributes
+            if (IsMapped())
+                indices_.assign(index_data_, index_data_ + 3 * face_count_);
+            vector<float>().swap(positions_);
+            vector<float>().swap(normals_);
+            vector<float>().swap(texcoords_);
+            storage_ = nullptr;
+            quantized_ = move(quantized);
+            UpdateViews();
+        }
+
+
+        FlatMesh
+            FlatMesh::Share()
+        {
+            if (!IsMapped()) {
+                // moved vectors keep their buffers, so the arrays stay put
+                auto owned = make_shared<FlatMesh>(move(*this));
+                Map(owned, owned->vertex_count_, owned->face_count_, owned->position_data_,
+                    owned->index_data_, owned->normal_data_, owned->texcoord_data_);
+                quantized_ = owned->quantized_;
+            }
+            // copies of a mapped mesh share its storage
+            return *this;
+        }
+
+
+        void
+            FlatMesh::UpdateViews()
+        {
+            vertex_count_ = quantized_ ? quantized_->positions.size() / 3 : positions_.size() / 3;
+            face_count_ = indices_.size() / 3;
+            position_data_ = positions_.empty() ? nullptr : positions_.data();
+            index_data_ = indices_.data();
+            normal_data_ = normals_.empty() ? nullptr : normals_.data();
+            texcoord_data_ = texcoords_.empty() ? nullptr : texcoords_.data();
+        }
+
+
+        AABB
+            FlatMesh::GetFaceBoundingBox(size_t f) const
+        {
+            AABB bbox;
+            const uint* face = GetFace(f);
+            for (int k = 0; k < 3; ++k)
+                bbox.ExpandBy(GetPosition(face[k]));
+            return bbox;
+        }
+
+
+        AABB
+            FlatMesh::GetBoundingBox() const
+        {
+            AABB bbox;
+            for (size_t v = 0; v < GetVertexCount(); ++v)
+                bbox.ExpandBy(GetPosition(v));
+            return bbox;
+        }
+
+
+        size_t
+            FlatMesh::GetMemory() const
+        {
+            if (IsQuantized()) {
+                size_t index_bytes = IsMapped() ? 3 * face_count_ * sizeof(uint) :
+                    indices_.capacity() * sizeof(uint);
+                return index_bytes + quantized_->positions.capacity() * sizeof(uint16_t) +
+                    quantized_->normals.capacity() * sizeof(int16_t) +
+                    quantized_->texcoords.capacity() * sizeof(uint16_t);
+            }
+            if (IsMapped()) {
+                return ((3 + (HasNormals() ? 3 : 0) + (HasTexCoords() ? 2 : 0)) *
+                    vertex_count_) * sizeof(float) + 3 * face_count_ * sizeof(uint);
+            }
+            return (positions_.capacity() + normals_.capacity() + texcoords_.capacity()) *
+                sizeof(float) + indices_.capacity() * sizeof(uint);
+        }
+
+
+        void
+            FlatMesh::ComputeVertexNormals()
+        {
+            MakeOwned();
+            const size_t vertex_count = GetVertexCount();
+            const size_t face_count = GetFaceCount();
+            normals_.assign(3 * vertex_count, 0.0f);
+            UpdateViews();
+            if (!face_count)
+                return;
+
+            // unit normal of face f, false if the face is degenerate
+            auto face_normal = [&](size_t f, Vec3f& normal) {
+                const uint* face = &index_data_[3 * f];
+                Vec3f p0 = Vec3f::Map(&position_data_[3 * face[0]]);
+                Vec3f p1 = Vec3f::Map(&position_data_[3 * face[1]]);
+                Vec3f p2 = Vec3f::Map(&position_data_[3 * face[2]]);
+                normal = (p1 - p2).cross(p2 - p0);
+                float length = normal.norm();
+                if (!(length > 0))
+                    return false;
+                normal /= length;
+                return true;
+            };
+
+            // each worker scatters the normals of its faces into partial
+            // sums covering just the range of vertices those faces use;
+            // after ReorderForLocality the ranges barely overlap
+            struct PartialSums {
+                size_t first{ 0 };
+                size_t last{ 0 };
+                vector<float> sums;
+            };
+            const size_t workers = GetParallelWorkerCount(face_count, kMinNormalFaces);
+            vector<PartialSums> partials(workers);
+            ParallelFor(face_count, [&](size_t begin, size_t end, size_t worker) {
+                auto& partial = partials[worker];
+                const uint* indices = &index_data_[3 * begin];
+                auto minmax = minmax_element(indices, &index_data_[3 * end]);
+                partial.first = *minmax.first;
+                partial.last = *minmax.second;
+            }, kMinNormalFaces);
+            size_t partial_size = 0;
+            for (const auto& partial : partials)
+                partial_size += partial.last - partial.first + 1;
+
+            if (workers == 1) {
+                Vec3f normal;
+                float* normals = normals_.data();
+                for (size_t f = 0; f < face_count; ++f) {
+                    if (!face_normal(f, normal))
+                        continue;
+                    const uint* face = &index_data_[3 * f];
+                    for (int k = 0; k < 3; ++k)
+                        Vec3f::Map(&normals[3 * face[k]]) += normal;
+                }
+            }
+            else if (partial_size <= 2 * vertex_count) {
+                ParallelFor(face_count, [&](size_t begin, size_t end, size_t worker) {
+                    auto& partial = partials[worker];
+                    partial.sums.assign(3 * (partial.last - partial.first + 1), 0.0f);
+                    Vec3f normal;
+                    for (size_t f = begin; f < end; ++f) {
+                        if (!face_normal(f, normal))
+                            continue;
+                        const uint* face = &index_data_[3 * f];
+                        for (int k = 0; k < 3; ++k)
+                            Vec3f::Map(&partial.sums[3 * (face[k] - partial.first)]) += normal;
+                    }
+                }, kMinNormalFaces);
+            }
+            else {
+                // faces are scattered over the whole mesh (e.g. not reordered):
+                // bin the face corners by vertex range with a parallel counting
+                // sort, then let each worker sum the corners of its own range
+                // straight into the normals, so no vertex is shared
+                const size_t bins = workers;
+                auto bin_of = [&](uint v) { return v * bins / vertex_count; };
+                vector<size_t> offsets(workers * bins, 0);  // [bin][worker]
+                ParallelFor(face_count, [&](size_t begin, size_t end, size_t worker) {
+                    for (size_t i = 3 * begin; i < 3 * end; ++i)
+                        ++offsets[bin_of(index_data_[i]) * workers + worker];
+                }, kMinNormalFaces);
+                vector<size_t> bin_begin(bins + 1, 0);
+                size_t offset = 0;
+                for (size_t i = 0; i < offsets.size(); ++i) {
+                    if (i % workers == 0)
+                        bin_begin[i / workers] = offset;
+                    size_t count = offsets[i];
+                    offsets[i] = offset;
+                    offset += count;
+                }
+                bin_begin[bins] = offset;
+                vector<size_t> corners(3 * face_count);  // face corner 3 * f + k
+                ParallelFor(face_count, [&](size_t begin, size_t end, size_t worker) {
+                    for (size_t i = 3 * begin; i < 3 * end; ++i)
+                        corners[offsets[bin_of(index_data_[i]) * workers + worker]++] = i;
+                }, kMinNormalFaces);
+                ParallelFor(bins, [&](size_t begin, size_t end, size_t) {
+                    Vec3f normal;
+                    float* normals = normals_.data();
+                    for (size_t i = bin_begin[begin]; i < bin_begin[end]; ++i) {
+                        if (face_normal(corners[i] / 3, normal))
+                            Vec3f::Map(&normals[3 * index_data_[corners[i]]]) += normal;
+                    }
+                });
+                partials.clear();
+            }
+
+            // gather the partial sums of each vertex and normalize
+            ParallelFor(vertex_count, [&](size_t begin, size_t end, size_t) {
+                float* normals = normals_.data();
+                for (const auto& partial : partials) {
+                    if (partial.sums.empty())
+                        continue;
+                    size_t first = max(begin, partial.first);
+                    size_t last = min(end, partial.last + 1);
+                    for (size_t v = first; v < last; ++v) {
+                        const float* sum = &partial.sums[3 * (v - partial.first)];
+                        normals[3 * v] += sum[0];
+                        normals[3 * v + 1] += sum[1];
+                        normals[3 * v + 2] += sum[2];
+                    }
+                }
+                for (size_t v = begin; v < end; ++v) {
+                    auto normal = Vec3f::Map(&normals[3 * v]);
+                    float length = normal.norm();
+                    if (length > 0)
+                        normal /= length;
+                }
+            }, kMinNormalFaces);
+        }
+
+
+        bool
+            FlatMesh::ReorderForLocality()
+        {
+            size_t face_count = GetFaceCount();
+            size_t vertex_count = GetVertexCount();
+            if (face_count < 2)
+                return false;
+            MakeOwned();
+
+            // sort faces by the Morton code of their centroids
+            vector<Vec3r> centroids(face_count);
+            for (size_t f = 0; f < face_count; ++f) {
+                const uint* face = GetFace(f);
+                centroids[f] = (GetPosition(face[0]) + GetPosition(face[1]) +
+                    GetPosition(face[2])) / 3;
+            }
+            auto face_order = MortonOrder(centroids);
+            centroids.clear();
+            centroids.shrink_to_fit();
+
+            // number vertices in order of first use; unreferenced vertices go last
+            const uint kUnvisited = static_cast<uint>(-1);
+            vector<uint> new_index(vertex_count, kUnvisited);
+            uint next = 0;
+            for (auto f : face_order) {
+                const uint* face = GetFace(f);
+                for (int k = 0; k < 3; ++k) {
+                    if (new_index[face[k]] == kUnvisited)
+                        new_index[face[k]] = next++;
+                }
+            }
+            for (auto& index : new_index) {
+                if (index == kUnvisited)
+                    index = next++;
+            }
+
+            // permute the arrays
+            vector<uint> indices(indices_.size());
+            for (size_t f = 0; f < face_count; ++f) {
+                const uint* face = GetFace(face_order[f]);
+                for (int k = 0; k < 3; ++k)
+                    indices[3 * f + k] = new_index[face[k]];
+            }
+            indices_.swap(indices);
+            auto permute = [&](vector<float>& values, int stride) {
+                vector<float> permuted(values.size());
+                for (size_t v = 0; v < vertex_count; ++v) {
+                    for (int k = 0; k < stride; ++k)
+                        permuted[stride * new_index[v] + k] = values[stride * v + k];
+                }
+                values.swap(permuted);
+            };
+            permute(positions_, 3);
+            if (HasNormals())
+                permute(normals_, 3);
+            if (HasTexCoords())
+                permute(texcoords_, 2);
+            UpdateViews();
+            return true;
+        }
+
+    }  // namespace core
+}  // namespace RT
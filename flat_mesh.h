@@ -0,0 +1,212 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "types.h"
+#include "aabb.h"
+#include "quantize.h"
+
+namespace RT {
+    namespace core {
+
+        // Compact render-time triangle mesh: float vertex positions, 32-bit
+        // vertex indices (three per face) and optional per-vertex normals and
+        // texture coordinates, each stored in a flat array. Unlike the
+        // OpenMesh halfedge structure it keeps no connectivity or status
+        // properties, so it is several times smaller and a face's vertices
+        // are reached with a single index lookup. The arrays are either
+        // owned or a read-only view of memory the mesh keeps alive (e.g. a
+        // memory-mapped \see MeshCache file); modifying a mapped mesh first
+        // copies it. A mesh can also be quantized (\see Quantize) to store
+        // vertex attributes compactly; getters then decode on access.
+        class FlatMesh {
+        public:
+            FlatMesh() = default;
+
+            FlatMesh(const FlatMesh& other);
+
+            FlatMesh& operator=(const FlatMesh& other);
+
+            FlatMesh(FlatMesh&& other) noexcept;
+
+            FlatMesh& operator=(FlatMesh&& other) noexcept;
+
+            // Resize arrays for the given number of vertices and faces;
+            // normal and texture coordinate arrays are only allocated if
+            // requested
+            void Resize(size_t vertex_count, size_t face_count, bool normals,
+                bool texcoords);
+
+            // Release all arrays
+            void Clear();
+
+            // View arrays in external memory instead of owning them;
+            // storage is kept alive as long as the mesh uses the arrays.
+            // normals and texcoords may be null.
+            void Map(std::shared_ptr<const void> storage, size_t vertex_count,
+                size_t face_count, const float* positions, const uint* indices,
+                const float* normals, const float* texcoords);
+
+            // Whether the arrays are a view of external memory
+            inline bool IsMapped() const { return storage_ != nullptr; }
+
+            // Copy mapped arrays into owned storage and decode a quantized
+            // mesh (no-op if already owned and not quantized)
+            void MakeOwned();
+
+            // Quantize the vertex attributes: positions to 16 bits per
+            // coordinate within the bounding box, normals to two 16-bit
+            // octahedral coordinates and texture coordinates to half floats
+            // (18 instead of 32 bytes per vertex). Face indices are kept.
+            void Quantize();
+
+            // Whether the vertex attributes are quantized
+            inline bool IsQuantized() const { return quantized_ != nullptr; }
+
+            // Get a read-only view of this mesh's arrays. Owned arrays are
+            // first moved into shared storage that this mesh then maps too,
+            // so the view stays valid whatever later happens to this mesh.
+            FlatMesh Share();
+
+            inline bool IsEmpty() const { return face_count_ == 0; }
+
+            inline size_t GetVertexCount() const { return vertex_count_; }
+
+            inline size_t GetFaceCount() const { return face_count_; }
+
+            inline bool HasNormals() const {
+                return quantized_ ? !quantized_->normals.empty() : normal_data_ != nullptr;
+            }
+
+            inline bool HasTexCoords() const {
+                return quantized_ ? !quantized_->texcoords.empty() : texcoord_data_ != nullptr;
+            }
+
+            // Setters write the owned arrays (\see MakeOwned for mapped meshes)
+            inline void SetPosition(size_t v, const Vec3r& p) {
+                for (int i = 0; i < 3; ++i)
+                    positions_[3 * v + i] = static_cast<float>(p[i]);
+            }
+
+            inline Vec3r GetPosition(size_t v) const {
+                if (quantized_) {
+                    const uint16_t* q = &quantized_->positions[3 * v];
+                    const float* origin = quantized_->origin;
+                    const float* scale = quantized_->scale;
+                    return Vec3r{ origin[0] + q[0] * scale[0], origin[1] + q[1] * scale[1],
+                        origin[2] + q[2] * scale[2] };
+                }
+                return Vec3r{ position_data_[3 * v], position_data_[3 * v + 1],
+                    position_data_[3 * v + 2] };
+            }
+
+            inline void SetNormal(size_t v, const Vec3r& n) {
+                for (int i = 0; i < 3; ++i)
+                    normals_[3 * v + i] = static_cast<float>(n[i]);
+            }
+
+            inline Vec3r GetNormal(size_t v) const {
+                if (quantized_)
+                    return OctDecode(&quantized_->normals[2 * v]).cast<Real>();
+                return Vec3r{ normal_data_[3 * v], normal_data_[3 * v + 1],
+                    normal_data_[3 * v + 2] };
+            }
+
+            inline void SetTexCoord(size_t v, const Vec2r& uv) {
+                texcoords_[2 * v] = static_cast<float>(uv[0]);
+                texcoords_[2 * v + 1] = static_cast<float>(uv[1]);
+            }
+
+            inline Vec2r GetTexCoord(size_t v) const {
+                if (quantized_) {
+                    return Vec2r{ HalfToFloat(quantized_->texcoords[2 * v]),
+                        HalfToFloat(quantized_->texcoords[2 * v + 1]) };
+                }
+                return Vec2r{ texcoord_data_[2 * v], texcoord_data_[2 * v + 1] };
+            }
+
+            inline void SetFace(size_t f, uint v0, uint v1, uint v2) {
+                indices_[3 * f] = v0;
+                indices_[3 * f + 1] = v1;
+                indices_[3 * f + 2] = v2;
+            }
+
+            // Get the three vertex indices of face f
+            inline const uint* GetFace(size_t f) const { return &index_data_[3 * f]; }
+
+            // Raw array access. The non-const versions are for loaders filling
+            // the arrays of an owned mesh in bulk (after \see Resize). The
+            // attribute arrays are null while the mesh is quantized.
+            inline float* GetPositionData() { return positions_.data(); }
+
+            inline const float* GetPositionData() const { return position_data_; }
+
+            inline float* GetNormalData() { return normals_.data(); }
+
+            inline const float* GetNormalData() const { return normal_data_; }
+
+            inline float* GetTexCoordData() { return texcoords_.data(); }
+
+            inline const float* GetTexCoordData() const { return texcoord_data_; }
+
+            inline uint* GetIndexData() { return indices_.data(); }
+
+            inline const uint* GetIndexData() const { return index_data_; }
+
+            // Compute bounding box of face f
+            AABB GetFaceBoundingBox(size_t f) const;
+
+            // Compute bounding box of all vertices
+            AABB GetBoundingBox() const;
+
+            // Get memory used by the arrays in bytes (for a mapped mesh,
+            // the size of the mapped arrays)
+            size_t GetMemory() const;
+
+            // Compute vertex normals as the normalized sum of the normals of
+            // the faces around each vertex, in parallel: workers scatter into
+            // partial sums over the vertex range their faces use (narrow once
+            // \see ReorderForLocality ran), or else into their own vertex
+            // range after binning the face corners by vertex
+            void ComputeVertexNormals();
+
+            // Reorder faces along a Morton (Z-order) curve of their centroids
+            // and vertices in order of first use by the sorted faces, so that
+            // spatially close triangles (and BVH leaves) are close in memory.
+            // Normals and texture coordinates follow their vertices.
+            bool ReorderForLocality();
+
+            static constexpr size_t kMinNormalFaces = 1 << 15;  // min faces per normal worker
+            static constexpr size_t kMinQuantizeVertices = 1 << 15;  // min vertices per worker
+        protected:
+            // Quantized vertex attributes; immutable once built, so copies
+            // and views of the mesh share them
+            struct QuantizedArrays {
+                std::vector<uint16_t> positions;  //!< (x, y, z) steps within the bbox
+                std::vector<int16_t> normals;     //!< octahedral (u, v), optional
+                std::vector<uint16_t> texcoords;  //!< half float (u, v), optional
+                float origin[3];                  //!< bbox min
+                float scale[3];                   //!< bbox extent / 65535
+            };
+
+            // Point the array views at the owned vectors
+            void UpdateViews();
+
+            std::vector<float> positions_;  //!< vertex positions (x, y, z)
+            std::vector<uint> indices_;     //!< face vertex indices (v0, v1, v2)
+            std::vector<float> normals_;    //!< vertex normals (x, y, z), optional
+            std::vector<float> texcoords_;  //!< vertex texture coordinates (u, v), optional
+
+            // views of the arrays, either the vectors above or mapped memory
+            const float* position_data_{ nullptr };
+            const uint* index_data_{ nullptr };
+            const float* normal_data_{ nullptr };
+            const float* texcoord_data_{ nullptr };
+            size_t vertex_count_{ 0 };
+            size_t face_count_{ 0 };
+            std::shared_ptr<const void> storage_;  //!< keeps mapped arrays alive
+            std::shared_ptr<const QuantizedArrays> quantized_;  //!< quantized attributes
+        };
+
+    }  // namespace core
+}  // namespace RT
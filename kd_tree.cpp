@@ -0,0 +1,231 @@
+#include "kd_tree.h"
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include "ray.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        KdTree::KdTree(const std::string& name) :
+            Accelerator{}
+        {
+            name_ = name.size() ? name : "KdTree";
+        }
+
+
+        bool
+            KdTree::BuildBounded(const std::vector<Surface::Ptr>& surfaces)
+        {
+            BuildMeshBVHs(surfaces);
+            nodes_.clear();
+            kd_surfaces_.clear();
+            surfaces_.clear();
+            bbox_.Reset();
+            bound_dirty_ = false;
+
+            vector<AABB> boxes;
+            for (const auto& surface : surfaces) {
+                if (!surface)
+                    continue;
+                AABB box = surface->GetBoundingBox();
+                if (!box.IsValid())
+                    continue;
+                surfaces_.push_back(surface);
+                boxes.push_back(box);
+                bbox_.ExpandBy(box);
+            }
+            if (surfaces_.empty())
+                return false;
+
+            // depth limit from pbrt: 8 + 1.3 log2(N), bounded by the stack
+            max_depth_ = static_cast<int>(8 + 1.3 * log2(static_cast<Real>(surfaces_.size())));
+            max_depth_ = std::min(max_depth_, kMaxStackDepth - 1);
+
+            vector<uint> indices(surfaces_.size());
+            for (size_t i = 0; i < indices.size(); ++i)
+                indices[i] = static_cast<uint>(i);
+            BuildNode(indices, bbox_, 0, boxes);
+            nodes_.shrink_to_fit();
+            kd_surfaces_.shrink_to_fit();
+
+            spdlog::info("Built kd-tree ({} nodes, {} references)", nodes_.size(),
+                kd_surfaces_.size());
+            return true;
+        }
+
+
+        void
+            KdTree::AddLeaf(const std::vector<uint>& indices)
+        {
+            KdTreeNode leaf{ 0, kLeaf, static_cast<uint>(kd_surfaces_.size()),
+                static_cast<uint>(indices.size()) };
+            kd_surfaces_.insert(kd_surfaces_.end(), indices.begin(), indices.end());
+            nodes_.push_back(leaf);
+        }
+
+
+        void
+            KdTree::BuildNode(const std::vector<uint>& indices, const AABB& node_box,
+                int depth, const std::vector<AABB>& boxes)
+        {
+            auto count = indices.size();
+            if (count <= static_cast<size_t>(max_leaf_size_) || depth >= max_depth_) {
+                AddLeaf(indices);
+                return;
+            }
+
+            // find the cheapest split among kBins candidates per axis; the
+            // surfaces below/above a candidate are counted from histograms of
+            // their min/max coordinates
+            const Vec3r& bmin = node_box.GetMin();
+            const Vec3r& bmax = node_box.GetMax();
+            const Vec3r& extent = bmax - bmin;
+            Real inv_area = 1 / node_box.GetSurfaceArea();
+            Real best_cost = intersect_cost_ * count;
+            int best_axis = -1;
+            Real best_split = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (!(extent[axis] > 0))
+                    continue;
+                uint min_bins[kBins] = { 0 };
+                uint max_bins[kBins] = { 0 };
+                Real bin_scale = kBins / extent[axis];
+                for (auto i : indices) {
+                    auto lo = static_cast<int>((boxes[i].GetMin()[axis] - bmin[axis]) * bin_scale);
+                    auto hi = static_cast<int>((boxes[i].GetMax()[axis] - bmin[axis]) * bin_scale);
+                    ++min_bins[CLAMP(lo, 0, kBins - 1)];
+                    ++max_bins[CLAMP(hi, 0, kBins - 1)];
+                }
+
+                // candidate b splits between bins b - 1 and b
+                size_t below = 0;
+                size_t above = count;
+                for (int b = 1; b < kBins; ++b) {
+                    below += min_bins[b - 1];
+                    above -= max_bins[b - 1];
+                    Real split = bmin[axis] + b / bin_scale;
+                    Vec3r below_max = bmax;
+                    below_max[axis] = split;
+                    Vec3r above_min = bmin;
+                    above_min[axis] = split;
+                    Real p_below = AABB{ bmin, below_max }.GetSurfaceArea() * inv_area;
+                    Real p_above = AABB{ above_min, bmax }.GetSurfaceArea() * inv_area;
+                    Real bonus = (below == 0 || above == 0) ? empty_bonus_ : 0;
+                    Real cost = traversal_cost_ + intersect_cost_ * (1 - bonus) *
+                        (p_below * below + p_above * above);
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = split;
+                    }
+                }
+            }
+            if (best_axis < 0) {
+                AddLeaf(indices);
+                return;
+            }
+
+            // partition; surfaces touching the plane go to both sides
+            vector<uint> below_indices, above_indices;
+            for (auto i : indices) {
+                if (boxes[i].GetMin()[best_axis] <= best_split)
+                    below_indices.push_back(i);
+                if (boxes[i].GetMax()[best_axis] >= best_split)
+                    above_indices.push_back(i);
+            }
+            if (below_indices.size() == count && above_indices.size() == count) {
+                AddLeaf(indices);
+                return;
+            }
+
+            // interior node, followed by the below subtree, then the above one
+            auto node_index = nodes_.size();
+            nodes_.push_back(KdTreeNode{ best_split, static_cast<uint>(best_axis), 0, 0 });
+            Vec3r below_max = bmax;
+            below_max[best_axis] = best_split;
+            Vec3r above_min = bmin;
+            above_min[best_axis] = best_split;
+            BuildNode(below_indices, AABB{ bmin, below_max }, depth + 1, boxes);
+            nodes_[node_index].offset = static_cast<uint>(nodes_.size());
+            BuildNode(above_indices, AABB{ above_min, bmax }, depth + 1, boxes);
+        }
+
+
+        bool
+            KdTree::HitBounded(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            Real t_enter, t_exit;
+            if (nodes_.empty() || !bbox_.Hit(ray, tmin, tmax, t_enter, t_exit))
+                return false;
+
+            const Vec3r origin = ray.GetOrigin();
+            const Vec3r dir = ray.GetDirection();
+            const Vec3r dir_inv{ 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+
+            struct StackEntry {
+                uint node;
+                Real tmin;
+                Real tmax;
+            };
+            StackEntry stack[kMaxStackDepth];
+            int top = 0;
+
+            bool had_hit = false;
+            Real closest = tmax;
+            SurfaceMailbox mailbox;  // surfaces straddling splits are tested once
+            uint node_index = 0;
+            Real node_tmin = t_enter;
+            Real node_tmax = t_exit;
+            for (;;) {
+                // nothing beyond the closest hit can matter
+                if (closest < node_tmin)
+                    break;
+
+                const auto& node = nodes_[node_index];
+                if (node.axis != kLeaf) {
+                    // order children by which side of the plane the ray starts on
+                    auto axis = node.axis;
+                    Real t_plane = (node.split - origin[axis]) * dir_inv[axis];
+                    bool below_first = origin[axis] < node.split ||
+                        (origin[axis] == node.split && dir[axis] <= 0);
+                    uint first = below_first ? node_index + 1 : node.offset;
+                    uint second = below_first ? node.offset : node_index + 1;
+
+                    if (t_plane > node_tmax || t_plane <= 0) {
+                        node_index = first;
+                    }
+                    else if (t_plane < node_tmin) {
+                        node_index = second;
+                    }
+                    else {
+                        stack[top++] = StackEntry{ second, t_plane, node_tmax };
+                        node_index = first;
+                        node_tmax = t_plane;
+                    }
+                    continue;
+                }
+
+                // leaf: intersect its surfaces
+                for (uint i = node.offset; i < node.offset + node.count; ++i) {
+                    if (mailbox.Contains(kd_surfaces_[i]))
+                        continue;
+                    if (surfaces_[kd_surfaces_[i]]->Hit(ray, tmin, closest, hit)) {
+                        closest = hit.t;
+                        had_hit = true;
+                    }
+                }
+
+                if (!top)
+                    break;
+                --top;
+                node_index = stack[top].node;
+                node_tmin = stack[top].tmin;
+                node_tmax = stack[top].tmax;
+            }
+            return had_hit;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,71 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "accelerator.h"
+
+namespace RT {
+    namespace core {
+
+        class Ray;
+        struct RayHit;
+
+        // Flattened kd-tree node. Interior nodes keep their below child right
+        // after themselves and store the index of the above child; leaves
+        // store a range of kd_surfaces_.
+        struct KdTreeNode {
+            Real split;     // split plane position (interior nodes)
+            uint axis;      // split axis (0, 1, 2) or kLeaf
+            uint offset;    // above child index (interior) or first surface (leaf)
+            uint count;     // number of surfaces (leaf)
+        };
+
+        // kd-tree accelerator built with the surface area heuristic (SAH)
+        // over binned split candidates. Surfaces straddling a split plane are
+        // referenced by both sides (and mailboxed, \see SurfaceMailbox);
+        // traversal is front to back and stops as soon as the closest hit
+        // lies before the next node's ray segment.
+        class KdTree : public Accelerator {
+        public:
+            RT_NODE(KdTree)
+
+                explicit KdTree(const std::string& name = std::string());
+
+            // Set SAH cost of intersecting a surface (relative to a traversal step)
+            inline void SetIntersectCost(Real cost) { intersect_cost_ = cost; }
+
+            inline Real GetIntersectCost() const { return intersect_cost_; }
+
+            // Set number of surfaces at or below which a node becomes a leaf
+            inline void SetMaxLeafSize(int size) { max_leaf_size_ = size; }
+
+            inline int GetMaxLeafSize() const { return max_leaf_size_; }
+
+            static constexpr uint kLeaf = 3;           // axis value of leaf nodes
+            static constexpr int kMaxStackDepth = 64;  // traversal stack size
+            static constexpr int kBins = 32;           // SAH split candidates per axis
+        protected:
+            bool BuildBounded(const std::vector<Surface::Ptr>& surfaces) override;
+
+            bool HitBounded(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            // Recursively build the subtree for the given surfaces
+            void BuildNode(const std::vector<uint>& indices, const AABB& node_box,
+                int depth, const std::vector<AABB>& boxes);
+
+            // Add a leaf for the given surfaces
+            void AddLeaf(const std::vector<uint>& indices);
+
+            std::vector<KdTreeNode> nodes_;      // flattened nodes (root is nodes_[0])
+            std::vector<uint> kd_surfaces_;      // surface indices referenced by leaves
+            std::vector<Surface::Ptr> surfaces_; // all surfaces
+            Real traversal_cost_{ 1 };           // SAH traversal cost
+            Real intersect_cost_{ 20 };          // SAH intersection cost
+            Real empty_bonus_{ 0.5 };            // SAH bonus for empty children
+            int max_leaf_size_{ 2 };             // leaf size threshold
+            int max_depth_{ 0 };                 // max tree depth
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -1,7 +1,6 @@
 #include "light.h"
 #include "surface.h"
 #include "ray.h"
-#include "phong_material.h"
 #include <iostream>
 
 namespace RT {
@@ -17,8 +16,8 @@ namespace RT {
 
 
         Vec3r
-            Light::Illuminate(const HitRecord&/*hit_record*/, const Vec3r&/*view_vec*/,
-                Surface::Ptr /*scene*/) const
+            Light::Illuminate(const ShadingContext&/*context*/,
+                const Surface::Ptr& /*scene*/) const
         {
             return Vec3r{ 0, 0, 0 };
         }
@@ -28,6 +27,7 @@ namespace RT {
             Light{ name }
         {
             name_ = name.size() ? name : "AmbientLight";
+            type_ = LightType::kAmbient;
         }
 
 
@@ -36,22 +36,15 @@ namespace RT {
             ambient_{ ambient }
         {
             name_ = name.size() ? name : "AmbientLight";
+            type_ = LightType::kAmbient;
         }
 
 
         Vec3r
-            AmbientLight::Illuminate(const HitRecord& hit_record, const Vec3r&/*view_vec*/,
-                Surface::Ptr /*scene*/) const
+            AmbientLight::Illuminate(const ShadingContext& context,
+                const Surface::Ptr& /*scene*/) const
         {
-            // only process phong materials
-            auto surface = hit_record.GetSurface();
-            if (!surface)
-                return Vec3r{ 0, 0, 0 };
-            auto phong_material = dynamic_pointer_cast<PhongMaterial>(surface->
-                GetMaterial());
-            if (!phong_material)
-                return Vec3r{ 0, 0, 0 };
-            return ambient_.cwiseProduct(phong_material->GetAmbient());
+            return ambient_.cwiseProduct(context.ambient);
         }
 
 
@@ -59,6 +52,7 @@ namespace RT {
             Light{ name }
         {
             name_ = name.size() ? name : "PointLight";
+            type_ = LightType::kPoint;
         }
 
 
@@ -69,51 +63,55 @@ namespace RT {
             intensity_{ intensity }
         {
             name_ = name.size() ? name : "PointLight";
+            type_ = LightType::kPoint;
         }
 
 
         Vec3r
-            PointLight::Illuminate(const HitRecord& hit_record, const Vec3r& view_vec,
-                Surface::Ptr scene) const
+            PointLight::Illuminate(const ShadingContext& context,
+                const Surface::Ptr& scene) const
         {
-            // evaluate hit points material
-            Vec3r black{ 0, 0, 0 };
-
-            // create a shadow ray to the point light and check for occlusion
-            const auto& hit_position = hit_record.GetPoint();
-            Ray shadow_ray{ hit_position, GetPosition() - hit_position };
-            HitRecord shadow_record;
-            if (scene->Hit(shadow_ray, kEpsilon, 1, shadow_record)) {
-                return black;
-            }
+            Vec3r light_vec, irradiance;
+            if (!SampleIrradiance(context, scene, 0,
+                light_vec, irradiance))
+                return Vec3r{ 0, 0, 0 };
+
+            // compute how much the material absorts light
+            const Vec3r& attenuation = context.Evaluate(light_vec);
+            return irradiance.cwiseProduct(attenuation);
+        }
 
-            // only process phong materials
-            auto surface = hit_record.GetSurface();
-            if (!surface)
-                return black;
-            auto phong_material = dynamic_pointer_cast<PhongMaterial>(surface->
-                GetMaterial());
-            if (!phong_material)
-                return black;
+
+        bool
+            PointLight::SampleIrradiance(const ShadingContext& context,
+                const Surface::Ptr& scene, int/*sample*/, Vec3r& light_vec,
+                Vec3r& irradiance) const
+        {
+            // create a shadow ray to the point light and check for occlusion;
+            // it sees the surface of the point at the level of detail it was
+            // hit at, so a coarse level does not shadow itself on the full mesh
+            const Vec3r& point = context.point;
+            const Vec3r& normal = context.normal;
+            Ray shadow_ray{ point, GetPosition() - point };
+            shadow_ray.SetLod(context.surface, context.lod_level);
+            RayHit shadow_hit;
+            if (scene->Hit(shadow_ray, kEpsilon, 1, shadow_hit))
+                return false;
 
             // compute irradiance at hit point
-            const Vec3r& normal = hit_record.GetNormal();
-            Vec3r light_vec = position_ - hit_position;
+            light_vec = position_ - point;
             auto distance2 = light_vec.squaredNorm();
             light_vec.normalize();
             auto denominator = std::max(kEpsilon2, distance2);
-            Vec3r irradiance = intensity_ * fmax(0.0f, normal.dot(light_vec)) / denominator;
-
-            // compute how much the material absorts light
-            const Vec3r& attenuation = phong_material->Evaluate(hit_record, light_vec,
-                view_vec);
-            return irradiance.cwiseProduct(attenuation);
+            irradiance = intensity_ * fmax(0.0f, normal.dot(light_vec)) / denominator;
+            return true;
         }
         //! \param[in] name Node name
         AreaLight::AreaLight(const std::string& name) :
             Light{ name }
         {
             name_ = name.size() ? name : "AreaLight";
+            type_ = LightType::kArea;
         }
 
         AreaLight::AreaLight(const Vec3r& center, const Vec3r& direction,
@@ -128,57 +126,61 @@ namespace RT {
             len_{ len }
         {
             name_ = name.size() ? name : "AreaLight";
+            type_ = LightType::kArea;
         }
 
 
-        Vec3r AreaLight::Illuminate(const HitRecord& hit_record, const Vec3r& view_vec,
-            std::shared_ptr<Surface> scene) const
+        Vec3r AreaLight::Illuminate(const ShadingContext& context,
+            const std::shared_ptr<Surface>& scene) const
         {
             Vec3r total_illumination{ 0,0,0, };
 
-            for (auto i : strat_increments_)
+            // the context is shared by all samples: no per-sample texture work
+            Vec3r light_vec, irradiance;
+            for (int sample = 0; sample < GetSampleCount(); ++sample)
             {
-                Vec3r black{ 0, 0, 0 };
-                // create a shadow ray to the point light and check for occlusion
-                const auto& hit_position = hit_record.GetPoint();
-                Real r = static_cast<Real>(std::rand());
-                r /= static_cast<Real>(RAND_MAX);
-                Real s = static_cast<Real>(std::rand());
-                s /= static_cast<Real>(RAND_MAX);
-                Real xoffset = r;
-                Real yoffset = s;
-                Vec3r sample_position = i + ((u_ * xoffset) / strat_samples_) +
-                    ((v_ * yoffset) / strat_samples_);
-
-                Ray shadow_ray{ hit_position, sample_position - hit_position };
-                HitRecord shadow_record;
-                if (scene->Hit(shadow_ray, kEpsilon, 1, shadow_record)) {
+                if (!SampleIrradiance(context, scene, sample,
+                    light_vec, irradiance))
                     continue;
-                }
-                // only process phong materials
-                auto surface = hit_record.GetSurface();
-                if (!surface)
-                    return black;
-                auto phong_material = dynamic_pointer_cast<PhongMaterial>(surface->
-                    GetMaterial());
-                if (!phong_material)
-                    return black;
-
-                // compute irradiance at hit point
-                const Vec3r& normal = hit_record.GetNormal();
-                Vec3r light_vec = sample_position - hit_position;
-                auto distance2 = light_vec.squaredNorm();
-                light_vec.normalize();
-                auto denominator = std::max(kEpsilon2, distance2);
-                Vec3r intensity = rgb_ * (-light_vec.dot(direction_));
-                Vec3r irradiance = intensity * fmax(0.0f, normal.dot(light_vec)) / denominator;
-                irradiance *= (len_ * len_);
                 // compute how much the material absorts light
-                const Vec3r& attenuation = phong_material->Evaluate(hit_record, light_vec,
-                    view_vec);
+                const Vec3r& attenuation = context.Evaluate(light_vec);
                 total_illumination += (irradiance.cwiseProduct(attenuation));
             }
-            return total_illumination / samples_;
+            return total_illumination;
+        }
+
+
+        bool AreaLight::SampleIrradiance(const ShadingContext& context,
+            const std::shared_ptr<Surface>& scene, int sample, Vec3r& light_vec,
+            Vec3r& irradiance) const
+        {
+            // jitter a position within the sample's stratum
+            const Vec3r& point = context.point;
+            const Vec3r& normal = context.normal;
+            Real r = static_cast<Real>(std::rand());
+            r /= static_cast<Real>(RAND_MAX);
+            Real s = static_cast<Real>(std::rand());
+            s /= static_cast<Real>(RAND_MAX);
+            Vec3r sample_position = strat_increments_[sample] +
+                ((u_ * r) / strat_samples_) + ((v_ * s) / strat_samples_);
+
+            // create a shadow ray to the sample and check for occlusion (at
+            // the level of detail of the point's surface)
+            Ray shadow_ray{ point, sample_position - point };
+            shadow_ray.SetLod(context.surface, context.lod_level);
+            RayHit shadow_hit;
+            if (scene->Hit(shadow_ray, kEpsilon, 1, shadow_hit))
+                return false;
+
+            // compute irradiance at hit point (averaged over the samples)
+            light_vec = sample_position - point;
+            auto distance2 = light_vec.squaredNorm();
+            light_vec.normalize();
+            auto denominator = std::max(kEpsilon2, distance2);
+            Vec3r intensity = rgb_ * (-light_vec.dot(direction_));
+            irradiance = intensity * fmax(0.0f, normal.dot(light_vec)) / denominator;
+            irradiance *= (len_ * len_) / samples_;
+            return true;
         }
 
         Vec3r AreaLight::ComputeV()
@@ -4,31 +4,65 @@
 #include <string>
 #include "types.h"
 #include "node.h"
+#include "shading_context.h"
 #include <random>
 
 namespace RT {
     namespace core {
 
         class Ray;
-        class HitRecord;
         class Surface;
 
+        // Concrete light type, for dispatch in the shading path without
+        // virtual calls
+        enum class LightType {
+            kNone,
+            kAmbient,
+            kPoint,
+            kArea
+        };
+
         class Light : public Node {
         public:
             RT_NODE(Light)
 
                 explicit Light(const std::string& name = std::string());
 
-            // Illuminate a hit point by retrieving its Phong material
-            // and evaluating it with a call to `Material::Eval()`
-            // param[in] hit_record Hit record for the point
-            // param[in] view_vec View vector (points away from the surface)
+            // Get concrete light type (set by the constructors)
+            inline LightType GetType() const { return type_; }
+
+            // Illuminate a hit point like \see Illuminate, dispatching on the
+            // light type with a switch instead of a virtual call
+            inline Vec3r Shade(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene) const;
+
+            // Get number of irradiance samples of the light (\see
+            // SampleIrradiance); zero for lights that are not sampled
+            inline int GetSampleCount() const;
+
+            // Sample the irradiance arriving at a point from the light,
+            // including the shadow test (dispatching on the light type)
+            // param[in] context Shading context of the point to illuminate
+            //           (point, normal and the level of detail it lies on)
+            // param[in] scene Pointer to the whole scene that's being rendered
+            // param[in] sample Sample index in [0, GetSampleCount())
+            // param[out] light_vec Unit vector from the point to the sample
+            // param[out] irradiance Irradiance arriving from the sample
+            // return False if the sample is occluded
+            inline bool SampleIrradiance(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene, int sample, Vec3r& light_vec,
+                Vec3r& irradiance) const;
+
+            // Illuminate a hit point by evaluating its shading context
+            // param[in] context Shading context of the point (\see
+            //           PhongMaterial::GetShadingContext)
             // param[in] scene Pointer to the whole scene that's being rendered
             // return Total radiance leaving the point in the direction of
-            //         view_vec
-            virtual Vec3r Illuminate(const HitRecord& hit_record, const Vec3r& view_vec,
-                std::shared_ptr<Surface> scene) const;
+            //        the context's view vector
+            virtual Vec3r Illuminate(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene) const;
         protected:
+            LightType type_{ LightType::kNone };  // concrete type
         };
 
         class AmbientLight : public Light {
@@ -39,15 +73,14 @@ namespace RT {
 
             AmbientLight(const Vec3r& ambient, const std::string& name = std::string());
 
-            // Illuminate a hit point by retrieving its Phong material
-            // and evaluating it with a call to `Material::Eval()`
-            // param[in] hit_record Hit record for the point
-            // param[in] view_vec View vector (points away from the surface)
+            // Illuminate a hit point by evaluating its shading context
+            // param[in] context Shading context of the point (\see
+            //           PhongMaterial::GetShadingContext)
             // param[in] scene Pointer to the whole scene that's being rendered
             // return Total radiance leaving the point in the direction of
-            // view_vec
-            Vec3r Illuminate(const HitRecord& hit_record, const Vec3r& view_vec,
-                std::shared_ptr<Surface> scene) const override;
+            //        the context's view vector
+            Vec3r Illuminate(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene) const override;
 
             void SetAmbient(const Vec3r& ambient) { ambient_ = ambient; }
 
@@ -65,15 +98,19 @@ namespace RT {
             PointLight(const Vec3r& position, const Vec3r& intensity,
                 const std::string& name = std::string());
 
-            // Illuminate a hit point by retrieving its Phong material
-            // and evaluating it with a call to `Material::Eval()`
-            // param[in] hit_record Hit record for the point
-            // param[in] view_vec View vector (points away from the surface)
+            // Illuminate a hit point by evaluating its shading context
+            // param[in] context Shading context of the point (\see
+            //           PhongMaterial::GetShadingContext)
             // param[in] scene Pointer to the whole scene that's being rendered
             // return Total radiance leaving the point in the direction of
-            //        view_vec
-            Vec3r Illuminate(const HitRecord& hit_record, const Vec3r& view_vec,
-                std::shared_ptr<Surface> scene) const override;
+            //        the context's view vector
+            Vec3r Illuminate(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene) const override;
+
+            // Sample the irradiance from the light (\see Light::SampleIrradiance)
+            bool SampleIrradiance(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene, int sample, Vec3r& light_vec,
+                Vec3r& irradiance) const;
 
             void SetPosition(const Vec3r& position) { position_ = position; }
 
@@ -97,8 +134,17 @@ namespace RT {
                 const Vec3r& u, const Vec3r& rgb, Real len,
                 const std::string& name = std::string());
 
-            Vec3r Illuminate(const HitRecord& hit_record, const Vec3r& view_vec,
-                std::shared_ptr<Surface> scene) const override;
+            Vec3r Illuminate(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene) const override;
+
+            // Sample the irradiance from one stratum of the light, jittered
+            // within it (\see Light::SampleIrradiance)
+            bool SampleIrradiance(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene, int sample, Vec3r& light_vec,
+                Vec3r& irradiance) const;
+
+            // Get number of strata sampled per hit
+            inline int GetSampleCount() const { return static_cast<int>(strat_increments_.size()); }
 
             Vec3r ComputeV();
 
@@ -144,5 +190,58 @@ namespace RT {
             int strat_samples_ = 1;
         };
 
+
+        inline Vec3r
+            Light::Shade(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene) const
+        {
+            // qualified calls are bound statically
+            switch (type_) {
+            case LightType::kAmbient:
+                return static_cast<const AmbientLight*>(this)->
+                    AmbientLight::Illuminate(context, scene);
+            case LightType::kPoint:
+                return static_cast<const PointLight*>(this)->
+                    PointLight::Illuminate(context, scene);
+            case LightType::kArea:
+                return static_cast<const AreaLight*>(this)->
+                    AreaLight::Illuminate(context, scene);
+            default:
+                return Illuminate(context, scene);
+            }
+        }
+
+
+        inline int
+            Light::GetSampleCount() const
+        {
+            switch (type_) {
+            case LightType::kPoint:
+                return 1;
+            case LightType::kArea:
+                return static_cast<const AreaLight*>(this)->GetSampleCount();
+            default:
+                return 0;
+            }
+        }
+
+
+        inline bool
+            Light::SampleIrradiance(const ShadingContext& context,
+                const std::shared_ptr<Surface>& scene, int sample, Vec3r& light_vec,
+                Vec3r& irradiance) const
+        {
+            switch (type_) {
+            case LightType::kPoint:
+                return static_cast<const PointLight*>(this)->
+                    SampleIrradiance(context, scene, sample, light_vec, irradiance);
+            case LightType::kArea:
+                return static_cast<const AreaLight*>(this)->
+                    SampleIrradiance(context, scene, sample, light_vec, irradiance);
+            default:
+                return false;
+            }
+        }
+
     }  // namespace core
 }  // namespace RT
@@ -10,11 +10,23 @@ namespace RT {
 		class Ray;
 		class HitRecord;
 
+		// Concrete material type, for dispatch in the shading path without
+		// RTTI
+		enum class MaterialType {
+			kNone,
+			kPhong,
+			kPhongDielectric
+		};
+
 		class Material : public Node {
 		public:
 			RT_NODE(Material)
 				explicit Material(const std::string& name = std::string());
+
+			// Get concrete material type (set by the constructors)
+			inline MaterialType GetType() const { return type_; }
 		protected:
+			MaterialType type_{ MaterialType::kNone };  // concrete type
 		};
 
 	}  // namespace core
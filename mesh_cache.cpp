@@ -0,0 +1,227 @@
+#include "mesh_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <spdlog/spdlog.h>
+#include "file_hash.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+        namespace fs = boost::filesystem;
+
+        namespace {
+
+            const char kMagic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0' };
+
+            // header flags
+            constexpr uint32_t kHasNormals = 1;
+            constexpr uint32_t kHasTexCoords = 2;
+            constexpr uint32_t kReordered = 4;
+
+            // File header; array offsets are from the start of the file
+            struct MeshCacheHeader {
+                char magic[8];
+                uint32_t version;
+                uint32_t flags;
+                uint64_t vertex_count;
+                uint64_t face_count;
+                uint64_t source_size;
+                int64_t source_mtime;
+                uint64_t source_hash;
+                float bbox_min[3];
+                float bbox_max[3];
+                uint64_t positions_offset;
+                uint64_t indices_offset;
+                uint64_t normals_offset;
+                uint64_t texcoords_offset;
+                uint64_t file_size;
+            };
+
+            inline uint64_t Align(uint64_t offset)
+            {
+                return (offset + MeshCache::kAlignment - 1) / MeshCache::kAlignment *
+                    MeshCache::kAlignment;
+            }
+
+        }  // namespace
+
+
+        fs::path
+            MeshCache::GetCachePath(const fs::path& source)
+        {
+            fs::path path = source;
+            path += ".rtmesh";
+            return path;
+        }
+
+
+        bool
+            MeshCache::Load(const fs::path& source, bool reordered, FlatMesh& mesh, AABB& bbox)
+        {
+            auto cache_path = GetCachePath(source);
+            boost::system::error_code ec;
+            if (!fs::exists(cache_path, ec))
+                return false;
+            auto source_size = fs::file_size(source, ec);
+            if (ec)
+                return false;
+            auto source_mtime = static_cast<int64_t>(fs::last_write_time(source, ec));
+            if (ec)
+                return false;
+
+            auto file = make_shared<boost::iostreams::mapped_file_source>();
+            try {
+                file->open(cache_path.string());
+            }
+            catch (const exception& e) {
+                spdlog::warn("MeshCache: cannot map {}: {}", cache_path.string(), e.what());
+                return false;
+            }
+            MeshCacheHeader header;
+            if (file->size() < sizeof(header))
+                return false;
+            memcpy(&header, file->data(), sizeof(header));
+            if (memcmp(header.magic, kMagic, sizeof(kMagic)) || header.version != kVersion ||
+                header.file_size != file->size()) {
+                spdlog::warn("MeshCache: ignoring invalid cache {}", cache_path.string());
+                return false;
+            }
+            if (((header.flags & kReordered) != 0) != reordered ||
+                header.source_size != source_size)
+                return false;
+            if (header.source_mtime != source_mtime) {
+                // touched or copied; still valid if the contents are unchanged
+                uint64_t hash;
+                if (!HashFile(source, hash) || hash != header.source_hash)
+                    return false;
+            }
+
+            // check the arrays lie within the file
+            const uint64_t vertex_count = header.vertex_count;
+            const uint64_t face_count = header.face_count;
+            auto in_file = [&](uint64_t offset, uint64_t bytes) {
+                return offset % kAlignment == 0 && offset <= header.file_size &&
+                    bytes <= header.file_size - offset;
+            };
+            bool normals = (header.flags & kHasNormals) != 0;
+            bool texcoords = (header.flags & kHasTexCoords) != 0;
+            if (!face_count || !in_file(header.positions_offset, 3 * vertex_count * sizeof(float)) ||
+                !in_file(header.indices_offset, 3 * face_count * sizeof(uint)) ||
+                (normals && !in_file(header.normals_offset, 3 * vertex_count * sizeof(float))) ||
+                (texcoords && !in_file(header.texcoords_offset, 2 * vertex_count * sizeof(float)))) {
+                spdlog::warn("MeshCache: ignoring invalid cache {}", cache_path.string());
+                return false;
+            }
+
+            // check every face index refers to a vertex, so a corrupt cache
+            // cannot make traversal read out of bounds
+            const char* data = file->data();
+            const uint* indices = reinterpret_cast<const uint*>(data + header.indices_offset);
+            uint max_index = 0;
+            for (uint64_t i = 0; i < 3 * face_count; ++i)
+                max_index = max(max_index, indices[i]);
+            if (max_index >= vertex_count) {
+                spdlog::warn("MeshCache: ignoring invalid cache {} (vertex index {} of {})",
+                    cache_path.string(), max_index, vertex_count);
+                return false;
+            }
+
+            mesh.Map(file, vertex_count, face_count,
+                reinterpret_cast<const float*>(data + header.positions_offset), indices,
+                normals ? reinterpret_cast<const float*>(data + header.normals_offset) : nullptr,
+                texcoords ? reinterpret_cast<const float*>(data + header.texcoords_offset) : nullptr);
+            bbox = AABB(Vec3r{ header.bbox_min[0], header.bbox_min[1], header.bbox_min[2] },
+                Vec3r{ header.bbox_max[0], header.bbox_max[1], header.bbox_max[2] });
+            spdlog::info("MeshCache: mapped {} ({} vertices, {} faces)",
+                cache_path.filename().string(), vertex_count, face_count);
+            return true;
+        }
+
+
+        bool
+            MeshCache::Save(const fs::path& source, bool reordered, const FlatMesh& mesh)
+        {
+            if (mesh.IsEmpty() || mesh.IsQuantized())
+                return false;
+            auto cache_path = GetCachePath(source);
+            boost::system::error_code ec;
+            MeshCacheHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.flags = (mesh.HasNormals() ? kHasNormals : 0u) |
+                (mesh.HasTexCoords() ? kHasTexCoords : 0u) | (reordered ? kReordered : 0u);
+            header.vertex_count = mesh.GetVertexCount();
+            header.face_count = mesh.GetFaceCount();
+            header.source_size = fs::file_size(source, ec);
+            if (!ec)
+                header.source_mtime = static_cast<int64_t>(fs::last_write_time(source, ec));
+            if (ec || !HashFile(source, header.source_hash)) {
+                spdlog::warn("MeshCache: cannot read {}", source.string());
+                return false;
+            }
+            AABB bbox = mesh.GetBoundingBox();
+            for (int i = 0; i < 3; ++i) {
+                header.bbox_min[i] = RoundDown(bbox.GetMin()[i]);
+                header.bbox_max[i] = RoundUp(bbox.GetMax()[i]);
+            }
+
+            // lay out the arrays
+            const uint64_t position_bytes = 3 * header.vertex_count * sizeof(float);
+            const uint64_t index_bytes = 3 * header.face_count * sizeof(uint);
+            const uint64_t normal_bytes = mesh.HasNormals() ? position_bytes : 0;
+            const uint64_t texcoord_bytes = mesh.HasTexCoords() ?
+                2 * header.vertex_count * sizeof(float) : 0;
+            header.positions_offset = Align(sizeof(header));
+            header.indices_offset = Align(header.positions_offset + position_bytes);
+            header.normals_offset = Align(header.indices_offset + index_bytes);
+            header.texcoords_offset = Align(header.normals_offset + normal_bytes);
+            header.file_size = header.texcoords_offset + texcoord_bytes;
+
+            // write to a temporary file first so a failed write never leaves
+            // a truncated cache behind
+            fs::path temp_path = cache_path;
+            temp_path += ".tmp";
+            {
+                ofstream out(temp_path.string(), ios::binary | ios::trunc);
+                if (!out) {
+                    spdlog::warn("MeshCache: cannot write {}", temp_path.string());
+                    return false;
+                }
+                const char padding[kAlignment] = {};
+                auto write_block = [&](uint64_t offset, const void* data, uint64_t bytes) {
+                    auto position = static_cast<uint64_t>(out.tellp());
+                    out.write(padding, static_cast<streamsize>(offset - position));
+                    out.write(static_cast<const char*>(data), static_cast<streamsize>(bytes));
+                };
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                write_block(header.positions_offset, mesh.GetPositionData(), position_bytes);
+                write_block(header.indices_offset, mesh.GetIndexData(), index_bytes);
+                if (normal_bytes)
+                    write_block(header.normals_offset, mesh.GetNormalData(), normal_bytes);
+                if (texcoord_bytes)
+                    write_block(header.texcoords_offset, mesh.GetTexCoordData(), texcoord_bytes);
+                write_block(header.file_size, nullptr, 0);
+                if (!out) {
+                    out.close();
+                    fs::remove(temp_path, ec);
+                    spdlog::warn("MeshCache: cannot write {}", temp_path.string());
+                    return false;
+                }
+            }
+            fs::rename(temp_path, cache_path, ec);
+            if (ec) {
+                fs::remove(temp_path, ec);
+                spdlog::warn("MeshCache: cannot write {}", cache_path.string());
+                return false;
+            }
+            spdlog::info("MeshCache: wrote {} ({} KB)", cache_path.filename().string(),
+                header.file_size / 1024);
+            return true;
+        }
+
+    }  // namespace core
+}  // namespace RT
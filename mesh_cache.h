@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <boost/filesystem.hpp>
+#include "flat_mesh.h"
+#include "aabb.h"
+
+namespace RT {
+    namespace core {
+
+        // Binary cache of loaded meshes. The file next to the source mesh
+        // (<source>.rtmesh) holds a header with the mesh's counts, bounding
+        // box and the size, modification time and content hash of the
+        // source, followed by the position, index, normal and texture
+        // coordinate arrays of the \see FlatMesh, each aligned to
+        // kAlignment bytes. Loading maps the file and points the flat mesh
+        // at the arrays, so no parsing or copying is done.
+        class MeshCache {
+        public:
+            // Get cache file path for a source mesh file
+            static boost::filesystem::path GetCachePath(const boost::filesystem::path& source);
+
+            // Map the cache of source into mesh if it exists and is up to
+            // date: the source must have the recorded size and either the
+            // recorded modification time or content hash. reordered must
+            // match the flag the cache was saved with.
+            // return Whether the cache was used; bbox is set to the mesh bounds
+            static bool Load(const boost::filesystem::path& source, bool reordered,
+                FlatMesh& mesh, AABB& bbox);
+
+            // Write the cache of mesh loaded from source
+            // return Whether the cache file was written
+            static bool Save(const boost::filesystem::path& source, bool reordered,
+                const FlatMesh& mesh);
+
+            static constexpr uint32_t kVersion = 1;     // file format version
+            static constexpr size_t kAlignment = 64;    // array alignment in bytes
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "types.h"
+#include "aabb.h"
+
+namespace RT {
+    namespace core {
+
+        // number of bits per axis in a 3D Morton code
+        static constexpr int kMortonBits = 21;
+
+        // Spread the lower 21 bits of v so that there are two zero bits
+        // between each original bit
+        inline uint64_t MortonExpandBits(uint64_t v)
+        {
+            v &= 0x1fffff;
+            v = (v | v << 32) & 0x1f00000000ffffull;
+            v = (v | v << 16) & 0x1f0000ff0000ffull;
+            v = (v | v << 8) & 0x100f00f00f00f00full;
+            v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+            v = (v | v << 2) & 0x1249249249249249ull;
+            return v;
+        }
+
+        // Compute the 63-bit Morton (Z-order) code of a point inside bbox
+        // param[in] point Point to encode (clamped to bbox)
+        // param[in] bbox Box spanning the whole point set
+        // return Morton code; points close in space get close codes
+        inline uint64_t MortonCode3D(const Vec3r& point, const AABB& bbox)
+        {
+            const Vec3r& bmin = bbox.GetMin();
+            const Vec3r& extent = bbox.GetMax() - bmin;
+            const Real cells = static_cast<Real>((1 << kMortonBits) - 1);
+            uint64_t code = 0;
+            for (int i = 0; i < 3; ++i) {
+                Real u = extent[i] > 0 ? (point[i] - bmin[i]) / extent[i] : 0;
+                u = CLAMP(u, 0, 1);
+                code |= MortonExpandBits(static_cast<uint64_t>(u * cells)) << (2 - i);
+            }
+            return code;
+        }
+
+        // Compute the permutation that sorts points along a Morton curve
+        // through their bounding box
+        // return order such that points[order[0]], points[order[1]], ...
+        // follow the curve
+        inline std::vector<uint> MortonOrder(const std::vector<Vec3r>& points)
+        {
+            AABB bbox;
+            for (const auto& point : points)
+                bbox.ExpandBy(point);
+            std::vector<std::pair<uint64_t, uint>> codes(points.size());
+            for (size_t i = 0; i < points.size(); ++i)
+                codes[i] = { MortonCode3D(points[i], bbox), static_cast<uint>(i) };
+            std::sort(codes.begin(), codes.end());
+            std::vector<uint> order(points.size());
+            for (size_t i = 0; i < points.size(); ++i)
+                order[i] = codes[i].second;
+            return order;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -7,8 +7,7 @@ namespace RT {
         using namespace std;
 
         // initialize static data members
-        size_t Node::node_count_ = 0;
-        std::mutex Node::node_count_mutex_;
+        std::atomic<size_t> Node::node_count_{ 0 };
 
         Node::Node(const std::string& name) :
             std::enable_shared_from_this<Node>()
@@ -43,8 +42,7 @@ namespace RT {
         void
             Node::SetGlobalNodeId()
         {
-            const std::lock_guard<std::mutex> lock(node_count_mutex_);
-            global_node_id_ = node_count_++;
+            global_node_id_ = node_count_.fetch_add(1, std::memory_order_relaxed);
         }
 
 
@@ -1,11 +1,12 @@
 #pragma once
+#include <atomic>
 #include <memory>
 #include <string>
 #include <thread>
-#include <mutex>
 #include <set>
 
 #include "types.h"
+#include "node_arena.h"
 
 namespace RT {
     namespace core {
@@ -18,6 +19,9 @@ namespace RT {
         // constructor when instantiating a Node instance
         void NodeDeleter(Node* node);
 
+        // Same for nodes placed in a \see NodeArena: only runs the destructor
+        void ArenaNodeDeleter(Node* node);
+
 #define RT_NODE_BASE(name) \
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW \
   using Ptr = std::shared_ptr<name>; \
@@ -25,7 +29,7 @@ namespace RT {
   using WeakPtr = std::weak_ptr<name>; \
   template<typename... Args> \
   static std::shared_ptr<name> Create(Args... args) { \
-    return Ptr(new name(args...), NodeDeleter);} \
+    return NodeArena::MakeNode<name>(args...);} \
   std::shared_ptr<name> GetPtr() { \
     return std::dynamic_pointer_cast<name>(shared_from_this());} \
   std::shared_ptr<name const> GetPtr() const { \
@@ -67,6 +71,8 @@ namespace RT {
             //        constructor when instantiating a Node instance
 
             friend void NodeDeleter(Node* node);
+
+            friend void ArenaNodeDeleter(Node* node);
         protected:
             // Copy constructor to be used only by Clone()
             Node(const Node& other);
@@ -80,8 +86,7 @@ namespace RT {
             std::string name_;          // node name
 
             // static data members
-            static size_t node_count_;  // total number of nodes ever created
-            static std::mutex node_count_mutex_;  // mutex used to set unique node id
+            static std::atomic<size_t> node_count_;  // total number of nodes ever created
         private:
             // Private function called by constructor to assign a
             //        unique id to each node
@@ -0,0 +1,180 @@
+#include "node_arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <spdlog/spdlog.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "node.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        namespace {
+
+            thread_local NodeArena::Ptr current_arena;
+
+            // Map size bytes of zeroed pages, trying huge pages first if
+            // requested; sets huge to whether they were granted
+            char* MapPages(size_t size, bool try_huge, bool& huge)
+            {
+                huge = false;
+#ifdef _WIN32
+                if (try_huge) {
+                    // needs the "Lock pages in memory" privilege
+                    SIZE_T large_page = GetLargePageMinimum();
+                    if (large_page && size % large_page == 0) {
+                        void* data = VirtualAlloc(nullptr, size,
+                            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                        if (data) {
+                            huge = true;
+                            return static_cast<char*>(data);
+                        }
+                    }
+                }
+                return static_cast<char*>(VirtualAlloc(nullptr, size,
+                    MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+                if (try_huge) {
+                    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    if (data != MAP_FAILED) {
+                        huge = true;
+                        return static_cast<char*>(data);
+                    }
+                }
+                void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (data == MAP_FAILED)
+                    return nullptr;
+#ifdef MADV_HUGEPAGE
+                // no reserved huge pages: ask for transparent ones instead
+                if (try_huge)
+                    madvise(data, size, MADV_HUGEPAGE);
+#endif
+                return static_cast<char*>(data);
+#endif
+            }
+
+            void UnmapPages(char* data, size_t size)
+            {
+#ifdef _WIN32
+                (void)size;
+                VirtualFree(data, 0, MEM_RELEASE);
+#else
+                munmap(data, size);
+#endif
+            }
+
+        }  // namespace
+
+
+        NodeArena::Scope::Scope(Ptr arena) :
+            previous_{ move(current_arena) }
+        {
+            current_arena = move(arena);
+        }
+
+
+        NodeArena::Scope::~Scope()
+        {
+            current_arena = move(previous_);
+        }
+
+
+        NodeArena::NodeArena(bool huge_pages, size_t block_size) :
+            huge_pages_{ huge_pages },
+            block_size_{ max(block_size, kDefaultBlockSize) }
+        {
+        }
+
+
+        NodeArena::Ptr
+            NodeArena::Create(bool huge_pages, size_t block_size)
+        {
+            return Ptr(new NodeArena(huge_pages, block_size));
+        }
+
+
+        NodeArena::~NodeArena()
+        {
+            for (const auto& block : blocks_)
+                UnmapPages(block.data, block.size);
+        }
+
+
+        const NodeArena::Ptr&
+            NodeArena::GetCurrent()
+        {
+            return current_arena;
+        }
+
+
+        void*
+            NodeArena::Allocate(size_t bytes, size_t alignment)
+        {
+            alignment = max(alignment, kMinAlignment);
+            auto align = [alignment](char* p) {
+                auto address = reinterpret_cast<uintptr_t>(p);
+                return reinterpret_cast<char*>((address + alignment - 1) & ~(alignment - 1));
+            };
+            char* data = align(next_);
+            if (!next_ || data + bytes > end_) {
+                AddBlock(bytes + alignment);
+                data = align(next_);
+            }
+            next_ = data + bytes;
+            allocated_ += bytes;
+            return data;
+        }
+
+
+        void
+            NodeArena::AddBlock(size_t min_bytes)
+        {
+            // whole blocks, so huge pages always fit exactly
+            size_t size = (min_bytes + block_size_ - 1) / block_size_ * block_size_;
+            bool huge;
+            char* data = MapPages(size, huge_pages_, huge);
+            if (!data)
+                throw bad_alloc();
+            if (huge_pages_ && !huge && blocks_.empty())
+                spdlog::warn("NodeArena: huge pages unavailable, using regular pages");
+            blocks_.push_back(Block{ data, size, huge });
+            next_ = data;
+            end_ = data + size;
+        }
+
+
+        size_t
+            NodeArena::GetReservedBytes() const
+        {
+            size_t bytes = 0;
+            for (const auto& block : blocks_)
+                bytes += block.size;
+            return bytes;
+        }
+
+
+        size_t
+            NodeArena::GetHugeBlockCount() const
+        {
+            return static_cast<size_t>(count_if(blocks_.begin(), blocks_.end(),
+                [](const Block& block) { return block.huge; }));
+        }
+
+
+        void
+            ArenaNodeDeleter(Node* node)
+        {
+            // the memory is released with the arena
+            node->~Node();
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace RT {
+    namespace core {
+
+        class Node;
+        void NodeDeleter(Node* node);
+        void ArenaNodeDeleter(Node* node);
+
+        // Bump allocator for the nodes of a scene (surfaces, BVH nodes,
+        // materials, textures, ...). While a \see NodeArena::Scope is active
+        // on a thread, Node::Create places new nodes and their shared_ptr
+        // control blocks contiguously in the arena's blocks instead of
+        // allocating each on the heap. Freeing a node only runs its
+        // destructor; the blocks are released in one go once the last node
+        // allocated from them is gone, since every control block keeps the
+        // arena alive. Allocation is not synchronized: an arena must only be
+        // current on one thread at a time.
+        class NodeArena {
+        public:
+            using Ptr = std::shared_ptr<NodeArena>;
+
+            // Allocator over arena memory; deallocation is a no-op
+            template<typename T>
+            class Allocator {
+            public:
+                using value_type = T;
+
+                explicit Allocator(Ptr arena) : arena_{ std::move(arena) } {}
+
+                template<typename U>
+                Allocator(const Allocator<U>& other) : arena_{ other.GetArena() } {}
+
+                T* allocate(size_t n) {
+                    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+                }
+
+                void deallocate(T*, size_t) {}
+
+                const Ptr& GetArena() const { return arena_; }
+
+                template<typename U>
+                bool operator==(const Allocator<U>& other) const { return arena_ == other.GetArena(); }
+
+                template<typename U>
+                bool operator!=(const Allocator<U>& other) const { return arena_ != other.GetArena(); }
+            private:
+                Ptr arena_;
+            };
+
+            // Make an arena the current one of this thread while in scope
+            class Scope {
+            public:
+                explicit Scope(Ptr arena);
+                ~Scope();
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+            private:
+                Ptr previous_;
+            };
+
+            // Create an arena allocating blocks of block_size bytes; with
+            // huge_pages the blocks are backed by large pages where the OS
+            // allows it (falling back to regular pages otherwise)
+            static Ptr Create(bool huge_pages = false, size_t block_size = kDefaultBlockSize);
+
+            ~NodeArena();
+            NodeArena(const NodeArena&) = delete;
+            NodeArena& operator=(const NodeArena&) = delete;
+
+            // Allocate bytes aligned to at least alignment
+            void* Allocate(size_t bytes, size_t alignment);
+
+            // Get the arena new nodes are created in on this thread, or null
+            static const Ptr& GetCurrent();
+
+            // Create a node in the current arena, or on the heap if none
+            template<typename T, typename... Args>
+            static std::shared_ptr<T> MakeNode(Args&&... args) {
+                const Ptr& arena = GetCurrent();
+                if (!arena)
+                    return std::shared_ptr<T>(new T(std::forward<Args>(args)...), NodeDeleter);
+                T* node = new (arena->Allocate(sizeof(T), alignof(T)))
+                    T(std::forward<Args>(args)...);
+                return std::shared_ptr<T>(node, ArenaNodeDeleter, Allocator<T>(arena));
+            }
+
+            // Get bytes handed out so far
+            inline size_t GetAllocatedBytes() const { return allocated_; }
+
+            // Get bytes of all blocks
+            size_t GetReservedBytes() const;
+
+            inline size_t GetBlockCount() const { return blocks_.size(); }
+
+            // Get number of blocks backed by huge pages
+            size_t GetHugeBlockCount() const;
+
+            static constexpr size_t kDefaultBlockSize = size_t{ 2 } << 20;  // one x86 huge page
+            static constexpr size_t kMinAlignment = 32;  // covers Eigen's AVX alignment
+        protected:
+            NodeArena(bool huge_pages, size_t block_size);
+
+            struct Block {
+                char* data;
+                size_t size;
+                bool huge;   // backed by huge pages
+            };
+
+            // Map a new block of at least min_bytes and allocate from it
+            void AddBlock(size_t min_bytes);
+
+            std::vector<Block> blocks_;
+            char* next_{ nullptr };   // next free byte of the current block
+            char* end_{ nullptr };    // end of the current block
+            size_t allocated_{ 0 };
+            bool huge_pages_;
+            size_t block_size_;
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,481 @@
+#include "obj_reader.h"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <spdlog/spdlog.h>
+#include "parallel.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+        namespace fs = boost::filesystem;
+
+        namespace {
+
+            // Geometry parsed from one chunk of the file. Corner indices are
+            // 0-based; -1 marks a missing texture coordinate/normal index.
+            struct ObjChunk {
+                vector<float> positions;  // v: x y z
+                vector<float> texcoords;  // vt: u v
+                vector<float> normals;    // vn: x y z
+                vector<long long> corners; // triangle corners: v vt vn
+                vector<size_t> relative;  // corners given relative to the chunk (negative indices)
+                bool error{ false };      // whether a line could not be parsed
+            };
+
+            inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+            inline void SkipSpaces(const char*& p, const char* end)
+            {
+                while (p < end && IsSpace(*p))
+                    ++p;
+            }
+
+            inline bool ParseInt(const char*& p, const char* end, long long& value)
+            {
+                bool negative = false;
+                if (p < end && (*p == '-' || *p == '+'))
+                    negative = *p++ == '-';
+                if (p >= end || *p < '0' || *p > '9')
+                    return false;
+                long long v = 0;
+                while (p < end && *p >= '0' && *p <= '9')
+                    v = v * 10 + (*p++ - '0');
+                value = negative ? -v : v;
+                return true;
+            }
+
+            // Parse a decimal floating point number (optionally with an
+            // exponent). Accumulates up to 19 significant digits in an
+            // integer and scales it by an exact power of ten when possible.
+            inline bool ParseFloat(const char*& p, const char* end, float& value)
+            {
+                static const double kPow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+                    1e20, 1e21, 1e22 };
+                const char* start = p;
+                bool negative = false;
+                if (p < end && (*p == '-' || *p == '+'))
+                    negative = *p++ == '-';
+                unsigned long long mantissa = 0;
+                int digits = 0;
+                int exponent = 0;
+                bool any_digit = false;
+                while (p < end && *p >= '0' && *p <= '9') {
+                    if (digits < 19) {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        if (mantissa)
+                            ++digits;
+                    }
+                    else {
+                        ++exponent;
+                    }
+                    any_digit = true;
+                    ++p;
+                }
+                if (p < end && *p == '.') {
+                    ++p;
+                    while (p < end && *p >= '0' && *p <= '9') {
+                        if (digits < 19) {
+                            mantissa = mantissa * 10 + (*p - '0');
+                            if (mantissa)
+                                ++digits;
+                            --exponent;
+                        }
+                        any_digit = true;
+                        ++p;
+                    }
+                }
+                if (!any_digit) {
+                    p = start;
+                    return false;
+                }
+                if (p < end && (*p == 'e' || *p == 'E')) {
+                    const char* exponent_start = p++;
+                    long long e;
+                    if (ParseInt(p, end, e))
+                        exponent += static_cast<int>(CLAMP(e, -400, 400));
+                    else
+                        p = exponent_start;
+                }
+                double v = static_cast<double>(mantissa);
+                if (exponent < 0)
+                    v = -exponent <= 22 ? v / kPow10[-exponent] : v * pow(10.0, exponent);
+                else if (exponent > 0)
+                    v = exponent <= 22 ? v * kPow10[exponent] : v * pow(10.0, exponent);
+                value = static_cast<float>(negative ? -v : v);
+                return true;
+            }
+
+            // Parse up to count floats into values (missing trailing values
+            // are set to 0)
+            inline bool ParseFloats(const char*& p, const char* end, int count,
+                vector<float>& values)
+            {
+                for (int i = 0; i < count; ++i) {
+                    SkipSpaces(p, end);
+                    float value = 0;
+                    if (!ParseFloat(p, end, value) && i == 0)
+                        return false;
+                    values.push_back(value);
+                }
+                return true;
+            }
+
+            // Parse one face corner (v, v/vt, v//vn or v/vt/vn); indices are
+            // returned 0-based, relative ones as offsets from the start of
+            // the parsed range
+            // given counts[3] elements (v, vt, vn) before the corner
+            inline bool ParseCorner(const char*& p, const char* end, const size_t counts[3],
+                long long corner[3], bool relative[3])
+            {
+                for (int k = 0; k < 3; ++k) {
+                    corner[k] = -1;
+                    relative[k] = false;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    if (k > 0) {
+                        if (p >= end || *p != '/')
+                            break;
+                        ++p;
+                    }
+                    long long index;
+                    if (!ParseInt(p, end, index)) {
+                        if (k == 0)
+                            return false;
+                        continue;  // empty vt in v//vn
+                    }
+                    if (index > 0) {
+                        corner[k] = index - 1;
+                    }
+                    else if (index < 0) {
+                        corner[k] = static_cast<long long>(counts[k]) + index;
+                        relative[k] = true;
+                    }
+                    else {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Parse the lines in [begin, end)
+            void ParseChunk(const char* begin, const char* end, ObjChunk& chunk)
+            {
+                vector<long long> polygon;
+                vector<char> polygon_relative;
+                const char* line = begin;
+                while (line < end) {
+                    const char* line_end = static_cast<const char*>(
+                        memchr(line, '\n', static_cast<size_t>(end - line)));
+                    if (!line_end)
+                        line_end = end;
+                    const char* p = line;
+                    line = line_end + 1;
+                    SkipSpaces(p, line_end);
+                    if (line_end - p < 2)
+                        continue;
+
+                    if (p[0] == 'v' && IsSpace(p[1])) {
+                        ++p;
+                        if (!ParseFloats(p, line_end, 3, chunk.positions))
+                            chunk.error = true;
+                    }
+                    else if (p[0] == 'v' && p[1] == 't') {
+                        p += 2;
+                        if (!ParseFloats(p, line_end, 2, chunk.texcoords))
+                            chunk.error = true;
+                    }
+                    else if (p[0] == 'v' && p[1] == 'n') {
+                        p += 2;
+                        if (!ParseFloats(p, line_end, 3, chunk.normals))
+                            chunk.error = true;
+                    }
+                    else if (p[0] == 'f' && IsSpace(p[1])) {
+                        ++p;
+                        polygon.clear();
+                        polygon_relative.clear();
+                        for (;;) {
+                            SkipSpaces(p, line_end);
+                            if (p >= line_end)
+                                break;
+                            const size_t counts[3] = { chunk.positions.size() / 3,
+                                chunk.texcoords.size() / 2, chunk.normals.size() / 3 };
+                            long long corner[3];
+                            bool relative[3];
+                            if (!ParseCorner(p, line_end, counts, corner, relative)) {
+                                chunk.error = true;
+                                break;
+                            }
+                            for (int k = 0; k < 3; ++k) {
+                                polygon.push_back(corner[k]);
+                                polygon_relative.push_back(relative[k]);
+                            }
+                        }
+
+                        // triangulate as a fan around the first corner
+                        size_t corner_count = polygon.size() / 3;
+                        for (size_t i = 1; i + 1 < corner_count; ++i) {
+                            for (size_t c : { size_t{ 0 }, i, i + 1 }) {
+                                for (int k = 0; k < 3; ++k) {
+                                    if (polygon_relative[3 * c + k])
+                                        chunk.relative.push_back(chunk.corners.size());
+                                    chunk.corners.push_back(polygon[3 * c + k]);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Hash of a (v, vt, vn) corner
+            struct CornerHash {
+                size_t operator()(const std::array<long long, 3>& c) const {
+                    return hash<long long>()(c[0] * 73856093LL ^ c[1] * 19349663LL ^
+                        c[2] * 83492791LL);
+                }
+            };
+
+            // Map the file at filepath for reading
+            bool MapFile(const fs::path& filepath, boost::iostreams::mapped_file_source& file)
+            {
+                boost::system::error_code ec;
+                auto file_size = fs::file_size(filepath, ec);
+                if (ec || file_size == 0) {
+                    spdlog::error("ObjReader: cannot read {}", filepath.string());
+                    return false;
+                }
+                try {
+                    file.open(filepath.string());
+                }
+                catch (const exception& e) {
+                    spdlog::error("ObjReader: cannot map {}: {}", filepath.string(), e.what());
+                    return false;
+                }
+                return true;
+            }
+
+        }  // namespace
+
+
+        bool
+            ObjReader::Read(const boost::filesystem::path& filepath, FlatMesh& mesh)
+        {
+            boost::iostreams::mapped_file_source file;
+            if (!MapFile(filepath, file))
+                return false;
+            const char* data = file.data();
+            const size_t size = file.size();
+
+            // split into chunks starting at line boundaries
+            size_t chunk_count = GetParallelWorkerCount(size, kMinChunkSize);
+            vector<const char*> bounds(chunk_count + 1, data + size);
+            bounds[0] = data;
+            for (size_t i = 1; i < chunk_count; ++i) {
+                const char* p = data + size * i / chunk_count;
+                p = max(p, bounds[i - 1]);
+                auto newline = static_cast<const char*>(memchr(p, '\n',
+                    static_cast<size_t>(data + size - p)));
+                bounds[i] = newline ? newline + 1 : data + size;
+            }
+
+            // parse chunks in parallel
+            vector<ObjChunk> chunks(chunk_count);
+            ParallelFor(chunk_count, [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; ++i)
+                    ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+            });
+
+            // merge chunks; relative indices are offset by the number of
+            // elements in the preceding chunks
+            vector<float> positions, texcoords, normals;
+            vector<long long> corners;
+            size_t offsets[3] = { 0, 0, 0 };
+            bool parse_error = false;
+            bool relative_error = false;  // relative index before the first element
+            {
+                size_t totals[4] = { 0, 0, 0, 0 };
+                for (const auto& chunk : chunks) {
+                    totals[0] += chunk.positions.size();
+                    totals[1] += chunk.texcoords.size();
+                    totals[2] += chunk.normals.size();
+                    totals[3] += chunk.corners.size();
+                }
+                positions.reserve(totals[0]);
+                texcoords.reserve(totals[1]);
+                normals.reserve(totals[2]);
+                corners.reserve(totals[3]);
+            }
+            for (auto& chunk : chunks) {
+                parse_error |= chunk.error;
+                for (auto i : chunk.relative) {
+                    chunk.corners[i] += static_cast<long long>(offsets[i % 3]);
+                    // checked here, as -1 would read as a missing attribute
+                    relative_error |= chunk.corners[i] < 0;
+                }
+                positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+                texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+                normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+                corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+                offsets[0] += chunk.positions.size() / 3;
+                offsets[1] += chunk.texcoords.size() / 2;
+                offsets[2] += chunk.normals.size() / 3;
+                chunk = ObjChunk();  // release chunk memory early
+            }
+            file.close();
+            if (parse_error)
+                spdlog::warn("ObjReader: skipped malformed lines in {}", filepath.string());
+            if (relative_error) {
+                spdlog::error("ObjReader: invalid face index in {}", filepath.string());
+                return false;
+            }
+
+            // validate indices and find which attributes are present
+            const size_t counts[3] = { offsets[0], offsets[1], offsets[2] };
+            const size_t corner_count = corners.size() / 3;
+            bool any_texcoord = false;
+            bool all_normals = corner_count > 0;
+            bool shared_indices = true;  // vt/vn indices equal the v index
+            for (size_t c = 0; c < corner_count; ++c) {
+                const long long* corner = &corners[3 * c];
+                for (int k = 0; k < 3; ++k) {
+                    if (corner[k] >= static_cast<long long>(counts[k]) || corner[k] < -1 ||
+                        (k == 0 && corner[k] < 0)) {
+                        spdlog::error("ObjReader: invalid face index in {}", filepath.string());
+                        return false;
+                    }
+                }
+                any_texcoord |= corner[1] >= 0;
+                all_normals &= corner[2] >= 0;
+                shared_indices &= (corner[1] < 0 || corner[1] == corner[0]) &&
+                    (corner[2] < 0 || corner[2] == corner[0]);
+            }
+            if (!corner_count) {
+                spdlog::error("ObjReader: no faces in {}", filepath.string());
+                return false;
+            }
+
+            // build the flat mesh; if corners use different v/vt/vn indices,
+            // each distinct combination becomes a vertex
+            const size_t face_count = corner_count / 3;
+            vector<uint> corner_vertex(corner_count);
+            vector<long long> vertex_corner;  // first corner of each vertex
+            size_t vertex_count;
+            if (shared_indices && (!any_texcoord || counts[1] >= counts[0]) &&
+                (!all_normals || counts[2] >= counts[0])) {
+                vertex_count = counts[0];
+                for (size_t c = 0; c < corner_count; ++c)
+                    corner_vertex[c] = static_cast<uint>(corners[3 * c]);
+            }
+            else {
+                unordered_map<std::array<long long, 3>, uint, CornerHash> vertex_map;
+                vertex_map.reserve(counts[0]);
+                for (size_t c = 0; c < corner_count; ++c) {
+                    std::array<long long, 3> key = { corners[3 * c], corners[3 * c + 1],
+                        corners[3 * c + 2] };
+                    auto result = vertex_map.emplace(key, static_cast<uint>(vertex_corner.size()));
+                    if (result.second)
+                        vertex_corner.push_back(static_cast<long long>(c));
+                    corner_vertex[c] = result.first->second;
+                }
+                vertex_count = vertex_corner.size();
+            }
+
+            mesh.Resize(vertex_count, face_count, all_normals, any_texcoord);
+            float* out_positions = mesh.GetPositionData();
+            float* out_normals = mesh.GetNormalData();
+            float* out_texcoords = mesh.GetTexCoordData();
+            if (vertex_corner.empty()) {
+                memcpy(out_positions, positions.data(), positions.size() * sizeof(float));
+                if (all_normals)
+                    memcpy(out_normals, normals.data(), 3 * vertex_count * sizeof(float));
+                if (any_texcoord)
+                    memcpy(out_texcoords, texcoords.data(), 2 * vertex_count * sizeof(float));
+            }
+            else {
+                ParallelFor(vertex_count, [&](size_t begin, size_t end, size_t) {
+                    for (size_t v = begin; v < end; ++v) {
+                        const long long* corner = &corners[3 * vertex_corner[v]];
+                        for (int i = 0; i < 3; ++i)
+                            out_positions[3 * v + i] = positions[3 * corner[0] + i];
+                        if (all_normals) {
+                            for (int i = 0; i < 3; ++i)
+                                out_normals[3 * v + i] = normals[3 * corner[2] + i];
+                        }
+                        if (any_texcoord && corner[1] >= 0) {
+                            out_texcoords[2 * v] = texcoords[2 * corner[1]];
+                            out_texcoords[2 * v + 1] = texcoords[2 * corner[1] + 1];
+                        }
+                    }
+                }, 1 << 16);
+            }
+            memcpy(mesh.GetIndexData(), corner_vertex.data(), corner_count * sizeof(uint));
+
+            spdlog::info("ObjReader: read {} ({} vertices, {} faces{}{}) using {} threads",
+                filepath.filename().string(), vertex_count, face_count,
+                all_normals ? ", normals" : "", any_texcoord ? ", texture coordinates" : "",
+                chunk_count);
+            return true;
+        }
+
+
+        bool
+            ObjReader::Scan(const boost::filesystem::path& filepath, ObjVisitor& visitor)
+        {
+            boost::iostreams::mapped_file_source file;
+            if (!MapFile(filepath, file))
+                return false;
+            const char* begin = file.data();
+            const char* end = begin + file.size();
+
+            // relative indices are offset by the number of elements in the
+            // preceding ranges, as in Read
+            size_t offsets[3] = { 0, 0, 0 };
+            bool parse_error = false;
+            ObjChunk chunk;
+            while (begin < end) {
+                const char* range_end = end;
+                if (static_cast<size_t>(end - begin) > kMinChunkSize) {
+                    auto newline = static_cast<const char*>(memchr(begin + kMinChunkSize, '\n',
+                        static_cast<size_t>(end - begin) - kMinChunkSize));
+                    range_end = newline ? newline + 1 : end;
+                }
+                chunk.positions.clear();
+                chunk.texcoords.clear();
+                chunk.normals.clear();
+                chunk.corners.clear();
+                chunk.relative.clear();
+                ParseChunk(begin, range_end, chunk);
+                begin = range_end;
+
+                parse_error |= chunk.error;
+                for (auto i : chunk.relative) {
+                    chunk.corners[i] += static_cast<long long>(offsets[i % 3]);
+                    if (chunk.corners[i] < 0) {
+                        spdlog::error("ObjReader: invalid face index in {}", filepath.string());
+                        return false;
+                    }
+                }
+                for (size_t i = 0; i < chunk.positions.size(); i += 3)
+                    visitor.Position(&chunk.positions[i]);
+                for (size_t i = 0; i < chunk.texcoords.size(); i += 2)
+                    visitor.TexCoord(&chunk.texcoords[i]);
+                for (size_t i = 0; i < chunk.normals.size(); i += 3)
+                    visitor.Normal(&chunk.normals[i]);
+                for (size_t i = 0; i < chunk.corners.size(); i += 9)
+                    visitor.Triangle(&chunk.corners[i]);
+                offsets[0] += chunk.positions.size() / 3;
+                offsets[1] += chunk.texcoords.size() / 2;
+                offsets[2] += chunk.normals.size() / 3;
+            }
+            if (parse_error)
+                spdlog::warn("ObjReader: skipped malformed lines in {}", filepath.string());
+            return true;
+        }
+
+    }  // namespace core
+}  // namespace RT
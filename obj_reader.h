@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <boost/filesystem.hpp>
+#include "flat_mesh.h"
+
+namespace RT {
+    namespace core {
+
+        // Receives the elements of an OBJ file from \see ObjReader::Scan;
+        // elements of each kind arrive in file order
+        class ObjVisitor {
+        public:
+            virtual ~ObjVisitor() = default;
+
+            virtual void Position(const float* xyz) {}
+            virtual void TexCoord(const float* uv) {}
+            virtual void Normal(const float* xyz) {}
+
+            // corners holds the 0-based (v, vt, vn) indices of the three
+            // corners; -1 marks a missing texture coordinate/normal index
+            virtual void Triangle(const long long* corners) {}
+        };
+
+        // Fast Wavefront OBJ reader. The file is memory-mapped and split
+        // into chunks at line boundaries which are parsed in parallel, then
+        // the per-chunk vertex, texture coordinate, normal and face arrays
+        // are merged directly into a \see FlatMesh. Polygons are triangulated
+        // as fans; only v, vt, vn and f statements are used.
+        class ObjReader {
+        public:
+            // Read the OBJ file at filepath into mesh
+            // return Whether the file could be read
+            static bool Read(const boost::filesystem::path& filepath, FlatMesh& mesh);
+
+            // Parse the OBJ file at filepath one kMinChunkSize range at a
+            // time and pass its elements to visitor without storing them,
+            // for files too large to read into memory. Indices are not
+            // checked against the element counts.
+            // return Whether the file could be read
+            static bool Scan(const boost::filesystem::path& filepath, ObjVisitor& visitor);
+
+            static constexpr size_t kMinChunkSize = 1 << 20;  // min bytes per parsing thread
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,988 @@
+#include "out_of_core_mesh.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <boost/algorithm/string.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <spdlog/spdlog.h>
+#include "file_hash.h"
+#include "obj_reader.h"
+#include "ray.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+        namespace fs = boost::filesystem;
+
+        namespace {
+
+            const char kChunkMagic[8] = { 'R', 'T', 'C', 'H', 'U', 'N', 'K', '\0' };
+            constexpr uint32_t kChunkVersion = 3;
+
+            // header flags
+            constexpr uint32_t kHasNormals = 1;
+            constexpr uint32_t kHasTexCoords = 2;
+
+            // File header, followed by the chunk arrays (positions, indices,
+            // normals, texcoords), the tree nodes and the chunk directory
+            // (written last, as the tree is only known once all chunks are)
+            struct ChunkFileHeader {
+                char magic[8];
+                uint32_t version;
+                uint32_t flags;
+                uint64_t node_count;
+                uint64_t chunk_count;
+                uint64_t chunk_faces;
+                uint64_t tree_offset;   // file offset of the tree nodes
+                uint64_t source_size;
+                int64_t source_mtime;
+                uint64_t source_hash;
+            };
+
+            // Chunk directory entry on disk
+            struct ChunkFileEntry {
+                uint64_t offset;
+                uint32_t vertex_count;
+                uint32_t face_count;
+            };
+
+            // Corner of a face record: the key of the source vertex it uses
+            // and that vertex's attributes
+            struct CornerRecord {
+                uint32_t key[3];      // source v, vt + 1, vn + 1 indices
+                float position[3];
+                float normal[3];
+                float texcoord[2];
+            };
+
+            // Face of the source mesh while the chunk file is built. Records
+            // carry their vertices so they can be partitioned on disk.
+            struct FaceRecord {
+                CornerRecord corners[3];
+
+                inline float GetCentroid(int axis) const {
+                    return (corners[0].position[axis] + corners[1].position[axis] +
+                        corners[2].position[axis]) / 3;
+                }
+
+                inline void ExpandBy(AABB& bbox) const {
+                    for (const auto& corner : corners)
+                        bbox.ExpandBy(Vec3r{ corner.position[0], corner.position[1],
+                            corner.position[2] });
+                }
+            };
+
+            // Hash of a vertex key
+            struct VertexKeyHash {
+                size_t operator()(const std::array<uint32_t, 3>& key) const {
+                    return hash<uint64_t>()(key[0] * 73856093ULL ^ key[1] * 19349663ULL ^
+                        key[2] * 83492791ULL);
+                }
+            };
+
+            constexpr size_t kRecordBlock = 4096;  // face records per file read
+            constexpr int kSplitBins = 1024;       // centroid bins of a split on disk
+
+            // File of face records
+            struct FaceRecordFile {
+                fs::path path;
+                size_t count{ 0 };
+                AABB centroid_box;                 // bounds of the face centroids
+            };
+
+            void AppendRecord(ofstream& out, const FaceRecord& face, FaceRecordFile& file)
+            {
+                out.write(reinterpret_cast<const char*>(&face), sizeof(face));
+                ++file.count;
+                file.centroid_box.ExpandBy(Vec3r{ face.GetCentroid(0), face.GetCentroid(1),
+                    face.GetCentroid(2) });
+            }
+
+            // Read the next block of records into block
+            // return Whether any record was read
+            bool ReadRecordBlock(ifstream& in, vector<FaceRecord>& block)
+            {
+                block.resize(kRecordBlock);
+                in.read(reinterpret_cast<char*>(block.data()),
+                    static_cast<streamsize>(block.size() * sizeof(FaceRecord)));
+                block.resize(static_cast<size_t>(in.gcount()) / sizeof(FaceRecord));
+                return !block.empty();
+            }
+
+            int GetLongestAxis(const AABB& bbox)
+            {
+                Vec3r extent = bbox.GetMax() - bbox.GetMin();
+                int axis = 0;
+                if (extent[1] > extent[axis]) axis = 1;
+                if (extent[2] > extent[axis]) axis = 2;
+                return axis;
+            }
+
+            // Temporary files of a chunk file build, removed when it ends
+            struct TempFiles {
+                vector<fs::path> paths;
+
+                fs::path Add(const fs::path& base, const string& suffix) {
+                    fs::path path = base;
+                    path += suffix;
+                    paths.push_back(path);
+                    return path;
+                }
+
+                ~TempFiles() {
+                    boost::system::error_code ec;
+                    for (const auto& path : paths)
+                        fs::remove(path, ec);
+                }
+            };
+
+            // First pass over an OBJ file: writes the vertex elements to
+            // binary files and gathers the face statistics \see ObjReader
+            // lays out vertices by
+            class ObjVertexPass : public ObjVisitor {
+            public:
+                void Position(const float* xyz) override { Append(0, xyz, 3); }
+                void TexCoord(const float* uv) override { Append(1, uv, 2); }
+                void Normal(const float* xyz) override { Append(2, xyz, 3); }
+
+                void Triangle(const long long* corners) override {
+                    ++face_count;
+                    for (int c = 0; c < 3; ++c) {
+                        const long long* corner = &corners[3 * c];
+                        any_texcoord |= corner[1] >= 0;
+                        all_normals &= corner[2] >= 0;
+                        shared_indices &= (corner[1] < 0 || corner[1] == corner[0]) &&
+                            (corner[2] < 0 || corner[2] == corner[0]);
+                    }
+                }
+
+                ofstream out[3];              // positions, texcoords, normals
+                size_t counts[3] = { 0, 0, 0 };
+                size_t face_count{ 0 };
+                bool any_texcoord{ false };
+                bool all_normals{ true };
+                bool shared_indices{ true };  // vt/vn indices equal the v index
+            private:
+                void Append(int element, const float* values, int count) {
+                    out[element].write(reinterpret_cast<const char*>(values),
+                        count * sizeof(float));
+                    ++counts[element];
+                }
+            };
+
+            // Second pass over an OBJ file: resolves the corners of each
+            // triangle against the memory-mapped vertex files of the first
+            // pass and writes its face record
+            class ObjFacePass : public ObjVisitor {
+            public:
+                void Triangle(const long long* corners) override {
+                    FaceRecord face;
+                    memset(&face, 0, sizeof(face));
+                    for (int c = 0; c < 3; ++c) {
+                        const long long* corner = &corners[3 * c];
+                        for (int k = 0; k < 3; ++k) {
+                            if (corner[k] >= static_cast<long long>(counts[k]) || corner[k] < -1 ||
+                                (k == 0 && corner[k] < 0)) {
+                                invalid = true;
+                                return;
+                            }
+                        }
+                        // as in ObjReader: shared indices make a vertex per
+                        // v index, else each (v, vt, vn) is a vertex
+                        const long long v = corner[0];
+                        const long long vt = shared ? (texcoords ? v : -1) : corner[1];
+                        const long long vn = shared ? v : corner[2];
+                        auto& record = face.corners[c];
+                        record.key[0] = static_cast<uint32_t>(v);
+                        record.key[1] = shared ? 0 : static_cast<uint32_t>(vt + 1);
+                        record.key[2] = shared ? 0 : static_cast<uint32_t>(vn + 1);
+                        memcpy(record.position, &data[0][3 * v], sizeof(record.position));
+                        if (normals)
+                            memcpy(record.normal, &data[2][3 * vn], sizeof(record.normal));
+                        if (texcoords && vt >= 0)
+                            memcpy(record.texcoord, &data[1][2 * vt], sizeof(record.texcoord));
+                    }
+                    AppendRecord(*out, face, *file);
+                }
+
+                const float* data[3] = { nullptr, nullptr, nullptr };  // mapped vertex files
+                size_t counts[3] = { 0, 0, 0 };
+                bool shared{ false };
+                bool normals{ false };
+                bool texcoords{ false };
+                ofstream* out{ nullptr };
+                FaceRecordFile* file{ nullptr };
+                bool invalid{ false };        // whether a corner index is out of range
+            };
+
+            // Write the face records of an OBJ file in two streaming passes;
+            // the vertex elements are kept in temporary files in between
+            bool WriteObjFaceRecords(const fs::path& source, const fs::path& temp_path,
+                TempFiles& temp_files, FaceRecordFile& file, bool& normals, bool& texcoords)
+            {
+                const char* suffixes[3] = { ".v", ".vt", ".vn" };
+                fs::path vertex_paths[3];
+                ObjVertexPass vertex_pass;
+                for (int k = 0; k < 3; ++k) {
+                    vertex_paths[k] = temp_files.Add(temp_path, suffixes[k]);
+                    vertex_pass.out[k].open(vertex_paths[k].string(), ios::binary | ios::trunc);
+                }
+                if (!ObjReader::Scan(source, vertex_pass))
+                    return false;
+                for (int k = 0; k < 3; ++k) {
+                    vertex_pass.out[k].close();
+                    if (!vertex_pass.out[k]) {
+                        spdlog::error("OutOfCoreMesh: cannot write {}", vertex_paths[k].string());
+                        return false;
+                    }
+                }
+                if (!vertex_pass.face_count) {
+                    spdlog::error("OutOfCoreMesh: no faces in {}", source.string());
+                    return false;
+                }
+                normals = vertex_pass.all_normals;
+                texcoords = vertex_pass.any_texcoord;
+
+                ObjFacePass face_pass;
+                boost::iostreams::mapped_file_source vertex_files[3];
+                for (int k = 0; k < 3; ++k) {
+                    face_pass.counts[k] = vertex_pass.counts[k];
+                    if (!vertex_pass.counts[k])
+                        continue;
+                    try {
+                        vertex_files[k].open(vertex_paths[k].string());
+                    }
+                    catch (const exception& e) {
+                        spdlog::error("OutOfCoreMesh: cannot map {}: {}", vertex_paths[k].string(),
+                            e.what());
+                        return false;
+                    }
+                    face_pass.data[k] = reinterpret_cast<const float*>(vertex_files[k].data());
+                }
+                const size_t* counts = vertex_pass.counts;
+                face_pass.shared = vertex_pass.shared_indices &&
+                    (!texcoords || counts[1] >= counts[0]) && (!normals || counts[2] >= counts[0]);
+                face_pass.normals = normals;
+                face_pass.texcoords = texcoords;
+                ofstream out(file.path.string(), ios::binary | ios::trunc);
+                face_pass.out = &out;
+                face_pass.file = &file;
+                if (!ObjReader::Scan(source, face_pass))
+                    return false;
+                if (face_pass.invalid) {
+                    spdlog::error("OutOfCoreMesh: invalid face index in {}", source.string());
+                    return false;
+                }
+                out.close();
+                if (!out) {
+                    spdlog::error("OutOfCoreMesh: cannot write {}", file.path.string());
+                    return false;
+                }
+                return true;
+            }
+
+            // Write the face records of a mesh in a format without a
+            // streaming reader, which is loaded whole
+            bool WriteMeshFaceRecords(const fs::path& source, FaceRecordFile& file,
+                bool& normals, bool& texcoords)
+            {
+                auto mesh = TriMesh::Create();
+                if (!mesh->Load(source, false, false))
+                    return false;
+                const FlatMesh& flat = mesh->GetFlatMesh();
+                normals = flat.HasNormals();
+                texcoords = flat.HasTexCoords();
+                ofstream out(file.path.string(), ios::binary | ios::trunc);
+                for (size_t f = 0; f < flat.GetFaceCount(); ++f) {
+                    const uint* fv = flat.GetFace(f);
+                    FaceRecord face;
+                    memset(&face, 0, sizeof(face));
+                    for (int c = 0; c < 3; ++c) {
+                        auto& record = face.corners[c];
+                        record.key[0] = fv[c];
+                        memcpy(record.position, &flat.GetPositionData()[3 * fv[c]],
+                            sizeof(record.position));
+                        if (normals)
+                            memcpy(record.normal, &flat.GetNormalData()[3 * fv[c]],
+                                sizeof(record.normal));
+                        if (texcoords)
+                            memcpy(record.texcoord, &flat.GetTexCoordData()[2 * fv[c]],
+                                sizeof(record.texcoord));
+                    }
+                    AppendRecord(out, face, file);
+                }
+                out.close();
+                if (!out) {
+                    spdlog::error("OutOfCoreMesh: cannot write {}", file.path.string());
+                    return false;
+                }
+                return true;
+            }
+
+            // Builds the chunk tree over a face record file depth first and
+            // writes the faces of each leaf as a chunk. Record files with
+            // more than memory_faces faces are split on disk along their
+            // longest centroid axis, at the centroid bin boundary closest to
+            // the median; smaller ones are read and split in memory at the
+            // centroid median until leaves have at most chunk_faces faces.
+            class ChunkTreeBuilder {
+            public:
+                ChunkTreeBuilder(ofstream& out, TempFiles& temp_files, const fs::path& temp_path,
+                    size_t chunk_faces, size_t memory_faces, bool normals, bool texcoords) :
+                    out_(out), temp_files_(temp_files), temp_path_(temp_path),
+                    chunk_faces_(chunk_faces), memory_faces_(max(memory_faces, chunk_faces)),
+                    normals_(normals), texcoords_(texcoords)
+                {
+                }
+
+                // Build the subtree over the faces of file, which is removed
+                bool Build(const FaceRecordFile& file)
+                {
+                    boost::system::error_code ec;
+                    if (file.count <= memory_faces_) {
+                        vector<FaceRecord> faces(file.count);
+                        ifstream in(file.path.string(), ios::binary);
+                        in.read(reinterpret_cast<char*>(faces.data()),
+                            static_cast<streamsize>(faces.size() * sizeof(FaceRecord)));
+                        if (!in)
+                            return false;
+                        in.close();
+                        fs::remove(file.path, ec);
+                        Split(faces, 0, faces.size());
+                        return true;
+                    }
+
+                    // bin the centroids along the longest axis and find the
+                    // face bounds
+                    const size_t index = nodes.size();
+                    nodes.push_back(OutOfCoreNode{});
+                    const int axis = GetLongestAxis(file.centroid_box);
+                    const Real low = file.centroid_box.GetMin()[axis];
+                    const Real extent = file.centroid_box.GetMax()[axis] - low;
+                    auto get_bin = [&](const FaceRecord& face) {
+                        int bin = extent > 0 ?
+                            static_cast<int>((face.GetCentroid(axis) - low) / extent * kSplitBins) : 0;
+                        return CLAMP(bin, 0, kSplitBins - 1);
+                    };
+                    AABB bbox;
+                    vector<size_t> bins(kSplitBins, 0);
+                    {
+                        ifstream in(file.path.string(), ios::binary);
+                        while (ReadRecordBlock(in, block_)) {
+                            for (const auto& face : block_) {
+                                face.ExpandBy(bbox);
+                                ++bins[get_bin(face)];
+                            }
+                        }
+                    }
+
+                    // split at the bin boundary closest to the median; if
+                    // no boundary separates the faces, split in file order
+                    int split_bin = -1;
+                    size_t below = 0;
+                    size_t best = file.count;
+                    for (int bin = 0; bin + 1 < kSplitBins; ++bin) {
+                        below += bins[bin];
+                        if (below == 0 || below == file.count)
+                            continue;
+                        size_t imbalance = 2 * below > file.count ?
+                            2 * below - file.count : file.count - 2 * below;
+                        if (imbalance < best) {
+                            best = imbalance;
+                            split_bin = bin;
+                        }
+                    }
+                    FaceRecordFile children[2];
+                    {
+                        ifstream in(file.path.string(), ios::binary);
+                        ofstream out[2];
+                        for (int side = 0; side < 2; ++side) {
+                            children[side].path = temp_files_.Add(temp_path_,
+                                "." + to_string(temp_files_.paths.size()));
+                            out[side].open(children[side].path.string(), ios::binary | ios::trunc);
+                        }
+                        size_t position = 0;
+                        while (ReadRecordBlock(in, block_)) {
+                            for (const auto& face : block_) {
+                                int side = split_bin >= 0 ? get_bin(face) > split_bin :
+                                    position++ >= file.count / 2;
+                                AppendRecord(out[side], face, children[side]);
+                            }
+                        }
+                        if (!out[0] || !out[1] ||
+                            children[0].count + children[1].count != file.count)
+                            return false;
+                    }
+                    fs::remove(file.path, ec);
+
+                    OutOfCoreNode node = MakeNode(bbox);
+                    node.axis = static_cast<uint16_t>(axis);
+                    if (!Build(children[0]))
+                        return false;
+                    node.offset = static_cast<uint32_t>(nodes.size());
+                    if (!Build(children[1]))
+                        return false;
+                    nodes[index] = node;
+                    return true;
+                }
+
+                vector<OutOfCoreNode> nodes;
+                vector<ChunkFileEntry> directory;
+            private:
+                OutOfCoreNode MakeNode(const AABB& bbox) const
+                {
+                    OutOfCoreNode node{};
+                    for (int i = 0; i < 3; ++i) {
+                        node.min[i] = RoundDown(bbox.GetMin()[i]);
+                        node.max[i] = RoundUp(bbox.GetMax()[i]);
+                    }
+                    return node;
+                }
+
+                // Recursively split faces[start, end) in memory
+                void Split(vector<FaceRecord>& faces, size_t start, size_t end)
+                {
+                    size_t index = nodes.size();
+                    nodes.push_back(OutOfCoreNode{});
+                    AABB bbox, centroid_box;
+                    for (size_t i = start; i < end; ++i) {
+                        faces[i].ExpandBy(bbox);
+                        centroid_box.ExpandBy(Vec3r{ faces[i].GetCentroid(0),
+                            faces[i].GetCentroid(1), faces[i].GetCentroid(2) });
+                    }
+                    const int axis = GetLongestAxis(centroid_box);
+                    OutOfCoreNode node = MakeNode(bbox);
+                    if (end - start <= chunk_faces_ ||
+                        !(centroid_box.GetMax()[axis] > centroid_box.GetMin()[axis])) {
+                        node.leaf = 1;
+                        node.offset = static_cast<uint32_t>(directory.size());
+                        WriteChunk(&faces[start], end - start);
+                        nodes[index] = node;
+                        return;
+                    }
+                    size_t mid = (start + end) / 2;
+                    nth_element(faces.begin() + start, faces.begin() + mid, faces.begin() + end,
+                        [axis](const FaceRecord& a, const FaceRecord& b) {
+                            return a.GetCentroid(axis) < b.GetCentroid(axis);
+                        });
+                    node.axis = static_cast<uint16_t>(axis);
+                    Split(faces, start, mid);
+                    node.offset = static_cast<uint32_t>(nodes.size());
+                    Split(faces, mid, end);
+                    nodes[index] = node;
+                }
+
+                // Write faces as the next chunk; each chunk gets its own copy
+                // of the vertices it uses
+                void WriteChunk(const FaceRecord* faces, size_t count)
+                {
+                    vertex_index_.clear();
+                    vertices_.clear();
+                    indices_.clear();
+                    for (size_t f = 0; f < count; ++f) {
+                        for (const auto& corner : faces[f].corners) {
+                            std::array<uint32_t, 3> key = { corner.key[0], corner.key[1],
+                                corner.key[2] };
+                            auto result = vertex_index_.emplace(key,
+                                static_cast<uint>(vertices_.size()));
+                            if (result.second)
+                                vertices_.push_back(&corner);
+                            indices_.push_back(result.first->second);
+                        }
+                    }
+
+                    ChunkFileEntry entry;
+                    entry.offset = static_cast<uint64_t>(out_.tellp());
+                    entry.vertex_count = static_cast<uint32_t>(vertices_.size());
+                    entry.face_count = static_cast<uint32_t>(count);
+                    directory.push_back(entry);
+                    auto write_values = [this](const vector<float>& values) {
+                        out_.write(reinterpret_cast<const char*>(values.data()),
+                            static_cast<streamsize>(values.size() * sizeof(float)));
+                    };
+                    values_.clear();
+                    for (auto corner : vertices_)
+                        values_.insert(values_.end(), corner->position, corner->position + 3);
+                    write_values(values_);
+                    out_.write(reinterpret_cast<const char*>(indices_.data()),
+                        static_cast<streamsize>(indices_.size() * sizeof(uint)));
+                    if (normals_) {
+                        values_.clear();
+                        for (auto corner : vertices_)
+                            values_.insert(values_.end(), corner->normal, corner->normal + 3);
+                        write_values(values_);
+                    }
+                    if (texcoords_) {
+                        values_.clear();
+                        for (auto corner : vertices_)
+                            values_.insert(values_.end(), corner->texcoord, corner->texcoord + 2);
+                        write_values(values_);
+                    }
+                }
+
+                ofstream& out_;
+                TempFiles& temp_files_;
+                fs::path temp_path_;
+                size_t chunk_faces_;
+                size_t memory_faces_;              // max faces split in memory
+                bool normals_;
+                bool texcoords_;
+                vector<FaceRecord> block_;         // record block being read
+                unordered_map<std::array<uint32_t, 3>, uint, VertexKeyHash> vertex_index_;
+                vector<const CornerRecord*> vertices_;
+                vector<uint> indices_;
+                vector<float> values_;
+            };
+
+            // Check that the tree and chunk directory read from a chunk file
+            // form a tree traversal can walk without indexing out of bounds:
+            // every node has one parent stored before it, leaves name
+            // existing chunks, the depth fits the traversal stack and every
+            // chunk lies within the chunk arrays [data_begin, data_end)
+            bool IsValidChunkTree(const vector<OutOfCoreNode>& nodes,
+                const vector<ChunkFileEntry>& directory, uint64_t data_begin,
+                uint64_t data_end, bool normals, bool texcoords)
+            {
+                // depth of each node, -1 until a parent claims it
+                vector<int> depth(nodes.size(), -1);
+                depth[0] = 0;
+                for (size_t i = 0; i < nodes.size(); ++i) {
+                    const auto& node = nodes[i];
+                    if (depth[i] < 0)
+                        return false;
+                    if (node.leaf) {
+                        if (node.offset >= directory.size())
+                            return false;
+                        continue;
+                    }
+                    if (node.axis > 2 || node.offset <= i + 1 || node.offset >= nodes.size() ||
+                        depth[i + 1] >= 0 || depth[node.offset] >= 0 ||
+                        depth[i] >= OutOfCoreMesh::kMaxStackDepth)
+                        return false;
+                    depth[i + 1] = depth[node.offset] = depth[i] + 1;
+                }
+                const uint64_t floats_per_vertex = 3 + (normals ? 3 : 0) + (texcoords ? 2 : 0);
+                for (const auto& entry : directory) {
+                    const uint64_t bytes = entry.vertex_count * floats_per_vertex * sizeof(float) +
+                        3 * uint64_t{ entry.face_count } * sizeof(uint);
+                    if (entry.offset < data_begin || entry.offset > data_end ||
+                        bytes > data_end - entry.offset)
+                        return false;
+                }
+                return true;
+            }
+
+        }  // namespace
+
+
+        OutOfCoreMesh::OutOfCoreMesh(const std::string& name) :
+            Surface{},
+            cache_{ make_shared<ChunkCache>() }
+        {
+            name_ = name.size() ? name : "OutOfCoreMesh";
+        }
+
+
+        fs::path
+            OutOfCoreMesh::GetChunkFilePath(const fs::path& source)
+        {
+            fs::path path = source;
+            path += ".rtchunks";
+            return path;
+        }
+
+
+        bool
+            OutOfCoreMesh::Load(const fs::path& filepath, size_t chunk_faces)
+        {
+            chunk_faces = max<size_t>(chunk_faces, 1);
+            auto chunk_path = GetChunkFilePath(filepath);
+            if (!ReadChunkFile(filepath, chunk_path) || nodes_.empty()) {
+                spdlog::info("OutOfCoreMesh: building chunk file {}", chunk_path.string());
+                if (!WriteChunkFile(filepath, chunk_path, chunk_faces) ||
+                    !ReadChunkFile(filepath, chunk_path))
+                    return false;
+            }
+            bound_dirty_ = true;
+            spdlog::info("OutOfCoreMesh: {} has {} chunks, memory budget {} MB",
+                filepath.filename().string(), cache_->chunks.size(), memory_budget_ >> 20);
+            return true;
+        }
+
+
+        bool
+            OutOfCoreMesh::WriteChunkFile(const fs::path& source, const fs::path& chunk_path,
+                size_t chunk_faces)
+        {
+            ChunkFileHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, kChunkMagic, sizeof(kChunkMagic));
+            header.version = kChunkVersion;
+            header.chunk_faces = chunk_faces;
+            boost::system::error_code ec;
+            header.source_size = fs::file_size(source, ec);
+            if (!ec)
+                header.source_mtime = static_cast<int64_t>(fs::last_write_time(source, ec));
+            if (ec || !HashFile(source, header.source_hash))
+                return false;
+
+            // the faces are first written as records next to the chunk file;
+            // OBJ files are streamed, other formats loaded whole
+            fs::path temp_path = chunk_path;
+            temp_path += ".tmp";
+            TempFiles temp_files;
+            FaceRecordFile records;
+            records.path = temp_files.Add(temp_path, ".faces");
+            bool normals = false, texcoords = false;
+            std::string extension = boost::algorithm::to_lower_copy(source.extension().string());
+            if (extension == ".obj" ?
+                !WriteObjFaceRecords(source, temp_path, temp_files, records, normals, texcoords) :
+                !WriteMeshFaceRecords(source, records, normals, texcoords))
+                return false;
+            header.flags = (normals ? kHasNormals : 0u) | (texcoords ? kHasTexCoords : 0u);
+
+            // write to a temporary file first so a failed write never leaves
+            // a truncated chunk file behind
+            temp_files.Add(temp_path, "");
+            {
+                ofstream out(temp_path.string(), ios::binary | ios::trunc);
+                if (!out) {
+                    spdlog::error("OutOfCoreMesh: cannot write {}", temp_path.string());
+                    return false;
+                }
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+                // faces are split in memory once they take at most the
+                // memory budget
+                ChunkTreeBuilder builder(out, temp_files, temp_path, chunk_faces,
+                    memory_budget_ / sizeof(FaceRecord), normals, texcoords);
+                const bool built = builder.Build(records);
+                header.tree_offset = static_cast<uint64_t>(out.tellp());
+                header.node_count = builder.nodes.size();
+                header.chunk_count = builder.directory.size();
+                out.write(reinterpret_cast<const char*>(builder.nodes.data()),
+                    static_cast<streamsize>(builder.nodes.size() * sizeof(OutOfCoreNode)));
+                out.write(reinterpret_cast<const char*>(builder.directory.data()),
+                    static_cast<streamsize>(builder.directory.size() * sizeof(ChunkFileEntry)));
+                out.seekp(0);
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                if (!built || !out) {
+                    spdlog::error("OutOfCoreMesh: cannot write {}", temp_path.string());
+                    return false;
+                }
+            }
+            fs::rename(temp_path, chunk_path, ec);
+            if (ec) {
+                spdlog::error("OutOfCoreMesh: cannot write {}", chunk_path.string());
+                return false;
+            }
+            return true;
+        }
+
+
+        bool
+            OutOfCoreMesh::ReadChunkFile(const fs::path& source, const fs::path& chunk_path)
+        {
+            auto& cache = *cache_;
+            lock_guard<mutex> lock(cache.mutex);
+            nodes_.clear();
+            cache.chunks.clear();
+            cache.resident.clear();
+            cache.resident_memory = 0;
+            cache.path = chunk_path;
+
+            boost::system::error_code ec;
+            if (!fs::exists(chunk_path, ec))
+                return false;
+            auto source_size = fs::file_size(source, ec);
+            if (ec)
+                return false;
+            auto source_mtime = static_cast<int64_t>(fs::last_write_time(source, ec));
+            if (ec)
+                return false;
+            const uint64_t file_size = fs::file_size(chunk_path, ec);
+            if (ec)
+                return false;
+
+            ifstream file(chunk_path.string(), ios::binary);
+            ChunkFileHeader header;
+            if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+                memcmp(header.magic, kChunkMagic, sizeof(kChunkMagic)) ||
+                header.version != kChunkVersion || header.source_size != source_size ||
+                !header.node_count)
+                return false;
+            if (header.source_mtime != source_mtime) {
+                // touched or copied; still valid if the contents are unchanged
+                uint64_t hash;
+                if (!HashFile(source, hash) || hash != header.source_hash)
+                    return false;
+            }
+            has_normals_ = (header.flags & kHasNormals) != 0;
+            has_texcoords_ = (header.flags & kHasTexCoords) != 0;
+            if (header.node_count > file_size / sizeof(OutOfCoreNode) ||
+                header.chunk_count > file_size / sizeof(ChunkFileEntry) ||
+                header.tree_offset < sizeof(header) || header.tree_offset > file_size ||
+                header.node_count * sizeof(OutOfCoreNode) +
+                header.chunk_count * sizeof(ChunkFileEntry) > file_size - header.tree_offset) {
+                spdlog::warn("OutOfCoreMesh: ignoring invalid {}", chunk_path.string());
+                return false;
+            }
+            nodes_.resize(header.node_count);
+            vector<ChunkFileEntry> directory(header.chunk_count);
+            file.seekg(static_cast<streamoff>(header.tree_offset));
+            file.read(reinterpret_cast<char*>(nodes_.data()),
+                static_cast<streamsize>(nodes_.size() * sizeof(OutOfCoreNode)));
+            file.read(reinterpret_cast<char*>(directory.data()),
+                static_cast<streamsize>(directory.size() * sizeof(ChunkFileEntry)));
+            if (!file) {
+                spdlog::warn("OutOfCoreMesh: ignoring truncated {}", chunk_path.string());
+                nodes_.clear();
+                return false;
+            }
+            if (!IsValidChunkTree(nodes_, directory, sizeof(header), header.tree_offset,
+                has_normals_, has_texcoords_)) {
+                spdlog::warn("OutOfCoreMesh: ignoring invalid {}", chunk_path.string());
+                nodes_.clear();
+                return false;
+            }
+            // entries hold atomics, so the directory is built in place
+            cache.chunks = vector<Chunk>(directory.size());
+            for (size_t c = 0; c < directory.size(); ++c) {
+                cache.chunks[c].offset = directory[c].offset;
+                cache.chunks[c].vertex_count = directory[c].vertex_count;
+                cache.chunks[c].face_count = directory[c].face_count;
+            }
+            return true;
+        }
+
+
+        TriMesh::Ptr
+            OutOfCoreMesh::AcquireChunk(uint32_t chunk, bool read)
+        {
+            auto& cache = *cache_;
+            auto& entry = cache.chunks[chunk];
+            // stamp a use with the current clock; the clock only advances on
+            // chunk reads, so repeated uses rarely write the entry
+            auto touch = [&]() {
+                uint64_t now = cache.use_clock.load(memory_order_relaxed);
+                if (entry.last_use.load(memory_order_relaxed) != now)
+                    entry.last_use.store(now, memory_order_relaxed);
+            };
+
+            // resident chunks are found without taking the cache lock
+            auto mesh = atomic_load(&entry.mesh);
+            if (mesh || !read) {
+                if (mesh)
+                    touch();
+                return mesh;
+            }
+            {
+                // wait if another query is reading the chunk, else claim it
+                unique_lock<mutex> lock(cache.mutex);
+                cache.loaded.wait(lock, [&entry]() { return !entry.loading; });
+                mesh = atomic_load(&entry.mesh);
+                if (mesh) {
+                    touch();
+                    return mesh;
+                }
+                entry.loading = true;
+            }
+
+            // read and build the BVH without holding the lock
+            mesh = ReadChunk(chunk);
+
+            lock_guard<mutex> lock(cache.mutex);
+            entry.loading = false;
+            cache.loaded.notify_all();
+            if (!mesh)
+                return nullptr;
+            entry.memory = mesh->GetFlatMesh().GetMemory() + entry.face_count * kBVHBytesPerFace;
+            entry.last_use.store(++cache.use_clock, memory_order_relaxed);
+            atomic_store(&entry.mesh, mesh);
+            cache.resident.push_back(chunk);
+            cache.resident_memory += entry.memory;
+            ++cache.chunk_reads;
+
+            // evict least recently used chunks over budget; meshes still
+            // referenced by a running query stay alive until it finishes
+            if (cache.resident_memory > memory_budget_) {
+                sort(cache.resident.begin(), cache.resident.end(),
+                    [&cache](uint32_t a, uint32_t b) {
+                        return cache.chunks[a].last_use.load(memory_order_relaxed) >
+                            cache.chunks[b].last_use.load(memory_order_relaxed);
+                    });
+                while (cache.resident_memory > memory_budget_ && cache.resident.size() > 1) {
+                    auto& victim = cache.chunks[cache.resident.back()];
+                    cache.resident.pop_back();
+                    cache.resident_memory -= victim.memory;
+                    atomic_store(&victim.mesh, TriMesh::Ptr{});
+                }
+            }
+            return mesh;
+        }
+
+
+        TriMesh::Ptr
+            OutOfCoreMesh::ReadChunk(uint32_t chunk) const
+        {
+            const auto& entry = cache_->chunks[chunk];
+            ifstream file(cache_->path.string(), ios::binary);
+            FlatMesh flat;
+            flat.Resize(entry.vertex_count, entry.face_count, has_normals_, has_texcoords_);
+            file.seekg(static_cast<streamoff>(entry.offset));
+            file.read(reinterpret_cast<char*>(flat.GetPositionData()),
+                3 * entry.vertex_count * sizeof(float));
+            file.read(reinterpret_cast<char*>(flat.GetIndexData()),
+                3 * entry.face_count * sizeof(uint));
+            if (has_normals_)
+                file.read(reinterpret_cast<char*>(flat.GetNormalData()),
+                    3 * entry.vertex_count * sizeof(float));
+            if (has_texcoords_)
+                file.read(reinterpret_cast<char*>(flat.GetTexCoordData()),
+                    2 * entry.vertex_count * sizeof(float));
+            if (!file) {
+                spdlog::error("OutOfCoreMesh: cannot read chunk {} of {}", chunk, GetName());
+                return nullptr;
+            }
+            const uint* indices = flat.GetIndexData();
+            for (size_t i = 0; i < 3 * size_t{ entry.face_count }; ++i) {
+                if (indices[i] >= entry.vertex_count) {
+                    spdlog::error("OutOfCoreMesh: invalid chunk {} of {}", chunk, GetName());
+                    return nullptr;
+                }
+            }
+
+            auto mesh = TriMesh::Create(GetName());
+            mesh->SetFlatMesh(move(flat));
+            mesh->SetMaterial(material_);
+            mesh->BuildBVH();
+            return mesh;
+        }
+
+
+        bool
+            OutOfCoreMesh::ChunkHit(uint32_t chunk, const TriMesh::Ptr& mesh, const Ray& ray,
+                Real tmin, Real tmax, RayHit& hit)
+        {
+            if (!mesh->Hit(ray, tmin, tmax, hit))
+                return false;
+            // the chunk may be evicted before shading, so record this mesh
+            // and the chunk rather than the chunk's mesh
+            hit.surface = this;
+            hit.part = chunk;
+            return true;
+        }
+
+
+        void
+            OutOfCoreMesh::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record)
+        {
+            // the chunk is usually still resident; otherwise it is read again
+            auto mesh = hit.part < cache_->chunks.size() ? AcquireChunk(hit.part, true) : nullptr;
+            if (!mesh) {
+                Surface::ComputeSurfaceInteraction(ray, hit, hit_record);
+                return;
+            }
+            RayHit chunk_hit = hit;
+            chunk_hit.surface = mesh.get();
+            chunk_hit.part = 0;
+            mesh->ComputeSurfaceInteraction(ray, chunk_hit, hit_record);
+        }
+
+
+        bool
+            OutOfCoreMesh::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            if (nodes_.empty())
+                return false;
+
+            const SlabRayf slab_ray(ray.GetOrigin(), ray.GetDirection());
+            const bool dir_neg[3] = { slab_ray.dir_inv[0] < 0, slab_ray.dir_inv[1] < 0,
+                slab_ray.dir_inv[2] < 0 };
+            const float tmin_f = RoundDown(tmin);
+
+            // chunks reached but not resident, with the ray's entry distance
+            vector<pair<Real, uint32_t>> queued;
+            uint32_t stack[kMaxStackDepth];
+            int top = 0;
+            uint32_t current = 0;
+            bool had_hit = false;
+            Real closest = tmax;
+            float closest_f = RoundUp(closest);
+            for (;;) {
+                const auto& node = nodes_[current];
+                if (AABB::SlabHitf(node.min, node.max, slab_ray, tmin_f, closest_f)) {
+                    if (node.leaf) {
+                        auto mesh = AcquireChunk(node.offset, false);
+                        if (mesh) {
+                            if (ChunkHit(node.offset, mesh, ray, tmin, closest, hit)) {
+                                closest = hit.t;
+                                closest_f = RoundUp(closest);
+                                had_hit = true;
+                            }
+                        }
+                        else {
+                            AABB box{ Vec3r{ node.min[0], node.min[1], node.min[2] },
+                                Vec3r{ node.max[0], node.max[1], node.max[2] } };
+                            Real t_enter, t_exit;
+                            if (box.Hit(ray, tmin, closest, t_enter, t_exit))
+                                queued.emplace_back(t_enter, node.offset);
+                        }
+                    }
+                    else {
+                        // visit the child on the ray's near side first
+                        if (dir_neg[node.axis]) {
+                            stack[top++] = current + 1;
+                            current = node.offset;
+                        }
+                        else {
+                            stack[top++] = node.offset;
+                            current = current + 1;
+                        }
+                        continue;
+                    }
+                }
+                if (!top)
+                    break;
+                current = stack[--top];
+            }
+
+            // read queued chunks front to back, skipping those behind the
+            // closest hit
+            sort(queued.begin(), queued.end());
+            for (const auto& chunk : queued) {
+                if (chunk.first > closest)
+                    break;
+                auto mesh = AcquireChunk(chunk.second, true);
+                if (mesh && ChunkHit(chunk.second, mesh, ray, tmin, closest, hit)) {
+                    closest = hit.t;
+                    had_hit = true;
+                }
+            }
+            return had_hit;
+        }
+
+
+        AABB
+            OutOfCoreMesh::GetBoundingBox(bool force_recompute)
+        {
+            // if bound is clean, just return existing bbox_
+            if (!force_recompute && !IsBoundDirty())
+                return bbox_;
+
+            bbox_.Reset();
+            if (nodes_.size()) {
+                const auto& root = nodes_[0];
+                bbox_ = AABB(Vec3r{ root.min[0], root.min[1], root.min[2] },
+                    Vec3r{ root.max[0], root.max[1], root.max[2] });
+            }
+            bound_dirty_ = false;
+            return bbox_;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "surface.h"
+#include "trimesh.h"
+
+namespace RT {
+    namespace core {
+
+        // Node of the tree over the chunks of an out-of-core mesh
+        // (depth-first layout: the first child directly follows its parent)
+        struct OutOfCoreNode {
+            float min[3];       // node box min coordinates
+            float max[3];       // node box max coordinates
+            uint32_t offset;    // second child index (inner) or chunk index (leaf)
+            uint16_t leaf;      // whether the node is a chunk
+            uint16_t axis;      // split axis (inner nodes)
+        };
+
+        // Triangle mesh rendered without holding its geometry in memory.
+        // On first use the mesh is split into spatially coherent chunks
+        // (the leaves of a median-split tree over face centroids) which are
+        // written to <mesh>.rtchunks. Only the tree is kept in memory;
+        // chunks are read on demand as traversal reaches them and kept in
+        // an LRU cache bounded by a memory budget, each as a \see TriMesh
+        // with its own BVH. OBJ sources are streamed when the chunk file
+        // is built: faces are partitioned on disk until a part fits in the
+        // memory budget, so the mesh is never held in memory whole. Within
+        // one ray query, chunks that are not resident are queued and only
+        // read after all resident chunks were tested, and skipped if a
+        // closer hit was found meanwhile. Resident chunks are looked up
+        // without locking; chunk reads and BVH builds run outside the
+        // cache lock.
+        class OutOfCoreMesh : public Surface {
+        public:
+            RT_NODE(OutOfCoreMesh)
+
+                explicit OutOfCoreMesh(const std::string& name = std::string());
+
+            // Open the chunk file of the mesh at filepath, (re)building it
+            // if it is missing or stale (checked like \see MeshCache: same
+            // size, and same mtime or content hash); chunk_faces is the max
+            // number of faces per chunk
+            bool Load(const boost::filesystem::path& filepath,
+                size_t chunk_faces = kDefaultChunkFaces);
+
+            bool Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit) override;
+
+            // Compute the attributes of a hit through its chunk's mesh (\see
+            // RayHit::part), reading the chunk again if it was evicted
+            void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record) override;
+
+            AABB GetBoundingBox(bool force_recompute = false) override;
+
+            // Set max bytes of chunk geometry and BVHs kept in memory
+            inline void SetMemoryBudget(size_t bytes) { memory_budget_ = bytes; }
+
+            inline size_t GetMemoryBudget() const { return memory_budget_; }
+
+            // Get bytes of chunk data currently resident
+            inline size_t GetResidentMemory() const { return cache_->resident_memory; }
+
+            inline size_t GetChunkCount() const { return cache_->chunks.size(); }
+
+            // Get number of chunk reads so far
+            inline size_t GetChunkReadCount() const { return cache_->chunk_reads; }
+
+            // Get chunk file path for a source mesh file
+            static boost::filesystem::path GetChunkFilePath(
+                const boost::filesystem::path& source);
+
+            static constexpr size_t kDefaultChunkFaces = 1 << 16;  // faces per chunk
+            static constexpr size_t kBVHBytesPerFace = 64;         // approx. chunk BVH memory
+            static constexpr int kMaxStackDepth = 64;              // traversal stack size
+        protected:
+            // Chunk directory entry
+            struct Chunk {
+                uint64_t offset{ 0 };        // file offset of the chunk's arrays
+                uint32_t vertex_count{ 0 };
+                uint32_t face_count{ 0 };
+                TriMesh::Ptr mesh;           // resident geometry or null (atomic access)
+                size_t memory{ 0 };          // bytes used while resident
+                bool loading{ false };       // whether a query is reading the chunk
+                std::atomic<uint64_t> last_use{ 0 };  // use clock at last use (LRU)
+            };
+
+            // Chunk directory and cache state; shared by clones of the mesh
+            struct ChunkCache {
+                std::vector<Chunk> chunks;   // chunk directory
+                boost::filesystem::path path;  // chunk file
+                std::vector<uint32_t> resident;  // resident chunks
+                size_t resident_memory{ 0 }; // resident bytes
+                size_t chunk_reads{ 0 };     // number of chunk reads (for stats)
+                std::atomic<uint64_t> use_clock{ 0 };  // advanced by each chunk read
+                std::mutex mutex;            // guards residency and loading flags
+                std::condition_variable loaded;  // signalled when a chunk read ends
+            };
+
+            // Split mesh into chunks and write the chunk file, using at most
+            // the memory budget for face records split in memory
+            bool WriteChunkFile(const boost::filesystem::path& source,
+                const boost::filesystem::path& chunk_path, size_t chunk_faces);
+
+            // Read the tree and chunk directory of the chunk file
+            bool ReadChunkFile(const boost::filesystem::path& source,
+                const boost::filesystem::path& chunk_path);
+
+            // Get chunk geometry if it is resident; otherwise, if read is
+            // set, read it (evicting least recently used chunks over
+            // budget), else return null
+            TriMesh::Ptr AcquireChunk(uint32_t chunk, bool read);
+
+            // Read a chunk from the chunk file into a mesh with its BVH; runs
+            // without the cache lock, through its own file handle
+            TriMesh::Ptr ReadChunk(uint32_t chunk) const;
+
+            // Intersect ray with a resident chunk
+            bool ChunkHit(uint32_t chunk, const TriMesh::Ptr& mesh, const Ray& ray,
+                Real tmin, Real tmax, RayHit& hit);
+
+            std::vector<OutOfCoreNode> nodes_;  // chunk tree (root is nodes_[0])
+            bool has_normals_{ false };         // whether chunks store vertex normals
+            bool has_texcoords_{ false };       // whether chunks store texture coordinates
+            size_t memory_budget_{ size_t{ 1 } << 30 };  // max resident bytes
+            std::shared_ptr<ChunkCache> cache_; // chunk directory and cache
+        };
+
+    }  // namespace core
+}  // namespace RT
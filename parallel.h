@@ -0,0 +1,46 @@
+#pragma once
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace RT {
+    namespace core {
+
+        // Get number of hardware threads (at least 1)
+        inline size_t GetThreadCount()
+        {
+            auto count = std::thread::hardware_concurrency();
+            return count ? count : 1;
+        }
+
+        // Get number of workers \see ParallelFor uses for count items when
+        // each worker should get at least min_range items
+        inline size_t GetParallelWorkerCount(size_t count, size_t min_range = 1)
+        {
+            min_range = std::max<size_t>(min_range, 1);
+            return std::max<size_t>(1, std::min(GetThreadCount(), count / min_range));
+        }
+
+        // Split [0, count) into one contiguous range per worker and call
+        // body(begin, end, worker) for each range on its own thread (the
+        // last range runs on the calling thread). Workers are numbered
+        // 0 .. GetParallelWorkerCount(count, min_range) - 1, so callers can
+        // keep per-worker partial results.
+        template <typename Body>
+        void ParallelFor(size_t count, Body body, size_t min_range = 1)
+        {
+            auto workers = GetParallelWorkerCount(count, min_range);
+            std::vector<std::thread> threads;
+            threads.reserve(workers - 1);
+            for (size_t worker = 0; worker + 1 < workers; ++worker) {
+                size_t begin = count * worker / workers;
+                size_t end = count * (worker + 1) / workers;
+                threads.emplace_back([&body, begin, end, worker]() { body(begin, end, worker); });
+            }
+            body(count * (workers - 1) / workers, count, workers - 1);
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -11,6 +11,7 @@ namespace RT {
             PhongMaterial{}
         {
             name_ = name.size() ? name : "PhongDielectric";
+            type_ = MaterialType::kPhongDielectric;
             SetDiffuse(Vec3r{ 1, 1, 1 });
         }
 
@@ -21,19 +22,18 @@ namespace RT {
             ior_{ ior }
         {
             name_ = name.size() ? name : "PhongDielectric";
+            type_ = MaterialType::kPhongDielectric;
             SetDiffuse(attenuation);
         }
 
 
         Vec3r
             PhongDielectric::Scatter(const HitRecord& hit_record,
-                const Ray& ray_in,
-                std::shared_ptr<Ray>& reflect_ray,
-                std::shared_ptr<Ray>& refract_ray,
+                const Ray& ray_in, Ray& reflect_ray, Ray& refract_ray, bool& refracted,
                 Real& schlick_reflectance) const
         {
-            // attenuation is stored in diffuse_  
-            Vec3r attenuation = dynamic_pointer_cast<SolidTexture>(diffuse_)->GetColor();
+            // attenuation is stored in diffuse_
+            Vec3r attenuation = solid_diffuse_ ? solid_diffuse_->GetColor() : Vec3r{ 1, 1, 1 };
 
             // compute incoming angle's cos/sin
             const Vec3r& normal = hit_record.GetNormal();
@@ -55,13 +55,12 @@ namespace RT {
                 schlick_reflectance = SchlicksReflectance(cos_theta, ior_in, ior_out);
 
             // create reflection ray
-            reflect_ray = make_shared<Ray>();
-            *reflect_ray = Ray::Reflect(ray_in, hit_record.GetPoint(), normal);
+            reflect_ray = Ray::Reflect(ray_in, hit_record.GetPoint(), normal);
 
             // create refraction ray
-            if (!reflect_only) {
-                refract_ray = make_shared<Ray>();
-                *refract_ray = Ray::Refract(ray_in, hit_record.GetPoint(), normal,
+            refracted = !reflect_only;
+            if (refracted) {
+                refract_ray = Ray::Refract(ray_in, hit_record.GetPoint(), normal,
                     ior_in, ior_out);
             }
             return attenuation;
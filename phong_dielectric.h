@@ -25,18 +25,18 @@ namespace RT {
 
             // Scatter incoming ray ray_in
             // details The function will generate a reflection and a refraction
-            //    ray. The refraction ray will be null (not generated) if there is total
+            //    ray. The refraction ray will not be generated if there is total
             //    internal reflection.
             // param[in] hit_record Hit record at hit point
             // param[in] ray_in Incoming ray that hit the point
             // param[out] reflect_ray Reflected ray
-            // param[out] refract_ray Refracted ray (null if not refracted)
+            // param[out] refract_ray Refracted ray (unset if not refracted)
+            // param[out] refracted Whether refract_ray was set
             // param[out] schlick_reflectance Schlick's reflectance
             // return Attenuation factor (how much color of reflected/refracted
             // rays should be attenuated)
             Vec3r Scatter(const HitRecord& hit_record, const Ray& ray_in,
-                std::shared_ptr<Ray>& reflect_ray,
-                std::shared_ptr<Ray>& refract_ray,
+                Ray& reflect_ray, Ray& refract_ray, bool& refracted,
                 Real& schlick_reflectance) const;
 
             // Set index of refraction
@@ -46,6 +46,13 @@ namespace RT {
             // Get index of refraction
             Real GetIOR() const { return ior_; }
 
+            // Get material as a dielectric if it is one, without RTTI; null
+            // otherwise
+            static inline const PhongDielectric* Cast(const Material* material) {
+                return material && material->GetType() == MaterialType::kPhongDielectric ?
+                    static_cast<const PhongDielectric*>(material) : nullptr;
+            }
+
             // Compute Schlick's reflectance
             // param[in] cos_theta cosine of angle between view vector and
             //           surface normal
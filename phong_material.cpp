@@ -11,6 +11,7 @@ namespace RT {
             Material{}
         {
             name_ = name.size() ? name : "PhongMaterial";
+            type_ = MaterialType::kPhong;
             SetDiffuse(Vec3r{ 0, 0, 0 });
         }
 
@@ -25,6 +26,7 @@ namespace RT {
             mirror_{ mirror }
         {
             name_ = name.size() ? name : "PhongMaterial";
+            type_ = MaterialType::kPhong;
             SetDiffuse(diffuse);
         }
 
@@ -32,38 +34,54 @@ namespace RT {
         void
             PhongMaterial::SetDiffuse(const Vec3r& diffuse)
         {
-            diffuse_ = SolidTexture::Create(diffuse);
+            SetDiffuse(SolidTexture::Create(diffuse));
         }
 
 
-        Vec3r
-            PhongMaterial::Evaluate(const HitRecord& hit_record, const Vec3r& light_vec,
+        ShadingContext
+            PhongMaterial::GetShadingContext(const HitRecord& hit_record,
                 const Vec3r& view_vec) const
         {
-            // Blinn-Phong halfway vector formulation
-            const Vec3r& normal = hit_record.GetNormal();
-            Vec3r half = (view_vec + light_vec).normalized();
-            auto half_dot = fmax(0, half.dot(normal));
-            Real specular_falloff = pow(half_dot, shininess_);
-            Vec3r specular_color = specular_falloff * specular_;
+            ShadingContext context;
+            context.point = hit_record.GetPoint();
+            context.normal = hit_record.GetNormal();
+            context.view_vec = view_vec;
+            context.ambient = ambient_;
+            context.specular = specular_;
+            context.shininess = shininess_;
+            context.surface = hit_record.GetSurface();
+            context.lod_level = hit_record.GetLodLevel();
 
             // handle backfacing surfaces
-            Vec3r diffuse_color{ 0,0,0 };
             if (diffuse_)
             {
                 const auto& uv = hit_record.GetFaceGeoUV().GetGlobalUV();
-                diffuse_color = diffuse_->Value(uv, hit_record.GetPoint());
+                // solid textures (the common case) skip the virtual call
+                context.diffuse = solid_diffuse_ ?
+                    solid_diffuse_->SolidTexture::Value(uv, hit_record.GetPoint()) :
+                    diffuse_->Value(uv, hit_record.GetPoint());
                 if (!hit_record.IsFrontFace()) {
-                    diffuse_color = Vec3r{ 1, 1, 0 };
-                    specular_color = Vec3r{ 0, 0, 0 };
+                    context.diffuse = Vec3r{ 1, 1, 0 };
+                    context.specular = Vec3r{ 0, 0, 0 };
                 }
             }
-            return specular_color + diffuse_color;
+            return context;
+        }
+
+
+        Vec3r
+            PhongMaterial::Evaluate(const HitRecord& hit_record, const Vec3r& light_vec,
+                const Vec3r& view_vec) const
+        {
+            // Blinn-Phong halfway vector formulation
+            return GetShadingContext(hit_record, view_vec).Evaluate(light_vec);
         }
         void
             PhongMaterial::SetDiffuse(Texture::Ptr diffuse)
         {
             diffuse_ = diffuse;
+            // resolve the texture type once here rather than per hit
+            solid_diffuse_ = dynamic_cast<SolidTexture*>(diffuse_.get());
         }
     }  // namespace core
 }  // namespace RT
\ No newline at end of file
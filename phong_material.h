@@ -6,6 +6,7 @@
 #include "material.h"
 #include "ray.h"
 #include "image_texture.h"
+#include "shading_context.h"
 
 
 namespace RT {
@@ -24,6 +25,11 @@ namespace RT {
                 Real shininess, const Vec3r& mirror = Vec3r{ 0, 0, 0 },
                 const std::string& name = std::string());
 
+            // Resolve the shading inputs of a hit (diffuse texture lookup,
+            // back face handling) once, for use with every light
+            ShadingContext GetShadingContext(const HitRecord& hit_record,
+                const Vec3r& view_vec) const;
+
             Vec3r Evaluate(const HitRecord& hit_record, const Vec3r& light_vec,
                 const Vec3r& view_vec) const;
 
@@ -46,9 +52,18 @@ namespace RT {
             Vec3r GetMirror() const { return mirror_; }
 
             void SetDiffuse(Texture::Ptr diffuse);
+
+            // Get material as a Phong material if it is one (including
+            // dielectrics), without RTTI; null otherwise
+            static inline const PhongMaterial* Cast(const Material* material) {
+                return material && (material->GetType() == MaterialType::kPhong ||
+                    material->GetType() == MaterialType::kPhongDielectric) ?
+                    static_cast<const PhongMaterial*>(material) : nullptr;
+            }
         protected:
             Vec3r ambient_{ 0, 0, 0 };      //!< ambient coefficients
             Texture::Ptr diffuse_;      //!< diffuse coefficients
+            SolidTexture* solid_diffuse_{ nullptr };  //!< diffuse_ if it is a solid texture
             Vec3r specular_{ 0, 0, 0 };     //!< specular coefficients
             Real shininess_{ 1 };           //!< shininess coefficient
             Vec3r mirror_{ 0, 0, 0 };       //!< mirror coefficients
@@ -0,0 +1,90 @@
+#include "plane.h"
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include "ray.h"
+#include "face_geouv.h"
+
+namespace RT {
+    namespace core {
+
+        Plane::Plane(const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "Plane";
+            bound_dirty_ = false;
+        }
+
+
+        Plane::Plane(const Vec3r& normal, Real d, const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "Plane";
+            SetPlane(normal, d);
+            bound_dirty_ = false;
+        }
+
+
+        void
+            Plane::SetPlane(const Vec3r& normal, Real d)
+        {
+            Real length = normal.norm();
+            if (!(length > 0)) {
+                spdlog::error("Plane::SetPlane: plane normal has zero length");
+                return;
+            }
+            normal_ = normal / length;
+            d_ = d / length;
+
+            // in-plane texture axes
+            Vec3r axis = fabs(normal_[0]) < 0.9 ? Vec3r{ 1, 0, 0 } : Vec3r{ 0, 1, 0 };
+            tangent_ = axis.cross(normal_).normalized();
+            bitangent_ = normal_.cross(tangent_);
+        }
+
+
+        AABB
+            Plane::GetBoundingBox(bool /*force_recompute*/)
+        {
+            // a plane has no finite bounds: bbox_ stays empty
+            return bbox_;
+        }
+
+
+        bool
+            Plane::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            const Vec3r& origin = ray.GetOrigin();
+            const Vec3r& dir = ray.GetDirection();
+            Real denom = normal_.dot(dir);
+            if (denom == 0)
+                return false;
+            Real t = (d_ - normal_.dot(origin)) / denom;
+            if (t < tmin || t > tmax)
+                return false;
+
+            hit.Set(t, this);
+            return true;
+        }
+
+
+        void
+            Plane::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record)
+        {
+            const Vec3r hit_point = ray.At(hit.t);
+            hit_record.SetPoint(hit_point);
+            hit_record.SetNormal(ray, normal_);
+            FaceGeoUV face_geouv;
+            face_geouv.SetFaceID(-1);
+            face_geouv.SetUV(Vec2r{ -1,-1 });
+
+            // textures repeat once per unit along the in-plane axes
+            Real u = hit_point.dot(tangent_);
+            Real v = hit_point.dot(bitangent_);
+            Vec2r uv{ u - floor(u), v - floor(v) };
+            face_geouv.SetGlobalUV(uv);
+            hit_record.SetFaceGeoUV(face_geouv);
+        }
+
+    }  // namespace core
+}  // namespace RT
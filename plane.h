@@ -0,0 +1,47 @@
+#pragma once
+#include <memory>
+#include <string>
+
+#include "surface.h"
+
+namespace RT {
+    namespace core {
+
+        // Infinite plane of points p with dot(normal, p) = d. Planes have no
+        // bounding box and are tested analytically outside the acceleration
+        // structure (\see Accelerator).
+        class Plane : public Surface {
+        public:
+            RT_NODE(Plane)
+
+                explicit Plane(const std::string& name = std::string());
+
+            Plane(const Vec3r& normal, Real d,
+                const std::string& name = std::string());
+
+            bool Hit(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record) override;
+
+            bool IsBounded() const override { return false; }
+
+            // Set plane equation; normal need not be unit length
+            void SetPlane(const Vec3r& normal, Real d);
+
+            Vec3r GetNormal() const { return normal_; }
+
+            Real GetD() const { return d_; }
+
+            AABB GetBoundingBox(bool force_recompute = false) override;
+        protected:
+            Vec3r normal_{ 0, 1, 0 };     //!< unit plane normal
+            Real d_{ 0 };                 //!< signed distance of plane from origin
+            Vec3r tangent_{ 1, 0, 0 };    //!< in-plane axis of the u texture coordinate
+            Vec3r bitangent_{ 0, 0, 1 };  //!< in-plane axis of the v texture coordinate
+        private:
+        };
+
+    }  // namespace core
+}  // namespace RT
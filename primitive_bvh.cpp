@@ -0,0 +1,260 @@
+#include "primitive_bvh.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "ray.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        PrimitiveBVH::PrimitiveBVH(const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "PrimitiveBVH";
+        }
+
+
+        AABB
+            PrimitiveBVH::GetBoundingBox(bool /*force_recompute*/)
+        {
+            // bounds are fixed when the tree is built
+            return bbox_;
+        }
+
+
+        bool
+            PrimitiveBVH::Build(std::vector<PrimitiveRef> primitives,
+                const std::vector<Surface::Ptr>& owners)
+        {
+            nodes_.clear();
+            primitives_.clear();
+            owners_ = owners;
+            bbox_.Reset();
+            bound_dirty_ = false;
+
+            // compute primitive bounds, dropping primitives without any
+            vector<PrimitiveRef> valid;
+            vector<AABB> boxes;
+            vector<Vec3r> centroids;
+            valid.reserve(primitives.size());
+            boxes.reserve(primitives.size());
+            centroids.reserve(primitives.size());
+            for (const auto& ref : primitives) {
+                if (!ref.surface)
+                    continue;
+                AABB box = ref.primitive == kWholeSurface ? ref.surface->GetBoundingBox() :
+                    ref.surface->GetPrimitiveBoundingBox(static_cast<size_t>(ref.primitive));
+                if (!box.IsValid())
+                    continue;
+                valid.push_back(ref);
+                boxes.push_back(box);
+                centroids.push_back((box.GetMin() + box.GetMax()) / 2);
+            }
+            primitives.clear();
+            primitives.shrink_to_fit();
+            if (valid.empty())
+                return false;
+
+            // build over an index permutation, then store primitives in leaf order
+            vector<uint> order(valid.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                order[i] = static_cast<uint>(i);
+            nodes_.reserve(2 * valid.size() / kMaxLeafSize + 1);
+            BuildNode(0, order.size(), order, boxes, centroids, 0);
+            primitives_.reserve(valid.size());
+            for (auto i : order)
+                primitives_.push_back(valid[i]);
+            nodes_.shrink_to_fit();
+            for (const auto& box : boxes)
+                bbox_.ExpandBy(box);
+
+            spdlog::info("Built primitive BVH ({}): {} nodes, {} primitives", GetName(),
+                nodes_.size(), primitives_.size());
+            return true;
+        }
+
+
+        void
+            PrimitiveBVH::BuildNode(size_t start, size_t end, std::vector<uint>& order,
+                const std::vector<AABB>& boxes, const std::vector<Vec3r>& centroids,
+                int depth)
+        {
+            auto node_index = nodes_.size();
+            nodes_.push_back(PrimitiveBVHNode{});
+
+            AABB node_box, centroid_box;
+            for (size_t i = start; i < end; ++i) {
+                node_box.ExpandBy(boxes[order[i]]);
+                centroid_box.ExpandBy(centroids[order[i]]);
+            }
+            const Vec3r& bmin = node_box.GetMin();
+            const Vec3r& bmax = node_box.GetMax();
+            for (int i = 0; i < 3; ++i) {
+                nodes_[node_index].min[i] = RoundDown(bmin[i]);
+                nodes_[node_index].max[i] = RoundUp(bmax[i]);
+            }
+
+            auto count = end - start;
+            auto make_leaf = [&]() {
+                nodes_[node_index].offset = static_cast<uint>(start);
+                nodes_[node_index].count = static_cast<ushort>(count);
+            };
+            if (count <= 1) {
+                make_leaf();
+                return;
+            }
+
+            // pick the split axis/position with a binned SAH over the
+            // centroids (or a median split once the tree gets deep)
+            const Vec3r& cmin = centroid_box.GetMin();
+            const Vec3r& cextent = centroid_box.GetMax() - cmin;
+            int axis = 0;
+            if (cextent[1] > cextent[axis])
+                axis = 1;
+            if (cextent[2] > cextent[axis])
+                axis = 2;
+            size_t mid = start + count / 2;
+            if (!(cextent[axis] > 0)) {
+                // all centroids coincide: split arbitrarily if too many
+                if (count <= kMaxLeafSize) {
+                    make_leaf();
+                    return;
+                }
+            }
+            else if (depth >= kMedianDepth) {
+                nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                    [&](uint a, uint b) { return centroids[a][axis] < centroids[b][axis]; });
+            }
+            else {
+                Real leaf_cost = static_cast<Real>(count);
+                Real best_cost = kInfinity;
+                int best_axis = -1;
+                int best_bin = 0;
+                Real inv_area = 1 / std::max(node_box.GetSurfaceArea(), kEpsilon2);
+                for (int a = 0; a < 3; ++a) {
+                    if (!(cextent[a] > 0))
+                        continue;
+                    AABB bin_boxes[kBins];
+                    size_t bin_counts[kBins] = { 0 };
+                    Real bin_scale = kBins / cextent[a];
+                    for (size_t i = start; i < end; ++i) {
+                        auto b = static_cast<int>((centroids[order[i]][a] - cmin[a]) * bin_scale);
+                        b = CLAMP(b, 0, kBins - 1);
+                        ++bin_counts[b];
+                        bin_boxes[b].ExpandBy(boxes[order[i]]);
+                    }
+
+                    // sweep from the right to get the cost of every split
+                    Real right_area[kBins];
+                    size_t right_count[kBins];
+                    AABB right_box;
+                    size_t right_total = 0;
+                    for (int b = kBins - 1; b > 0; --b) {
+                        right_box.ExpandBy(bin_boxes[b]);
+                        right_total += bin_counts[b];
+                        right_area[b] = right_box.GetSurfaceArea();
+                        right_count[b] = right_total;
+                    }
+                    AABB left_box;
+                    size_t left_total = 0;
+                    for (int b = 1; b < kBins; ++b) {
+                        left_box.ExpandBy(bin_boxes[b - 1]);
+                        left_total += bin_counts[b - 1];
+                        if (!left_total || !right_count[b])
+                            continue;
+                        Real cost = 0.125f + (left_total * left_box.GetSurfaceArea() +
+                            right_count[b] * right_area[b]) * inv_area;
+                        if (cost < best_cost) {
+                            best_cost = cost;
+                            best_axis = a;
+                            best_bin = b;
+                        }
+                    }
+                }
+
+                if (best_axis < 0 || (count <= kMaxLeafSize && best_cost >= leaf_cost)) {
+                    if (count <= kMaxLeafSize) {
+                        make_leaf();
+                        return;
+                    }
+                }
+                else {
+                    axis = best_axis;
+                    Real bin_scale = kBins / cextent[axis];
+                    auto split = partition(order.begin() + start, order.begin() + end,
+                        [&](uint i) {
+                            auto b = static_cast<int>((centroids[i][axis] - cmin[axis]) * bin_scale);
+                            return CLAMP(b, 0, kBins - 1) < best_bin;
+                        });
+                    mid = static_cast<size_t>(split - order.begin());
+                }
+                if (mid == start || mid == end) {
+                    mid = start + count / 2;
+                    nth_element(order.begin() + start, order.begin() + mid,
+                        order.begin() + end, [&](uint a, uint b) {
+                            return centroids[a][axis] < centroids[b][axis]; });
+                }
+            }
+
+            // inner node: first child follows, second child index in offset
+            nodes_[node_index].axis = static_cast<ushort>(axis);
+            nodes_[node_index].count = 0;
+            BuildNode(start, mid, order, boxes, centroids, depth + 1);
+            nodes_[node_index].offset = static_cast<uint>(nodes_.size());
+            BuildNode(mid, end, order, boxes, centroids, depth + 1);
+        }
+
+
+        bool
+            PrimitiveBVH::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            if (nodes_.empty())
+                return false;
+
+            const SlabRayf slab_ray(ray.GetOrigin(), ray.GetDirection());
+            const bool dir_neg[3] = { slab_ray.dir_inv[0] < 0, slab_ray.dir_inv[1] < 0,
+                slab_ray.dir_inv[2] < 0 };
+            const float tmin_f = RoundDown(tmin);
+
+            uint stack[kMaxStackDepth];
+            int top = 0;
+            uint current = 0;
+            bool had_hit = false;
+            Real closest = tmax;
+            float closest_f = RoundUp(closest);
+            for (;;) {
+                const auto& node = nodes_[current];
+                if (AABB::SlabHitf(node.min, node.max, slab_ray, tmin_f, closest_f)) {
+                    if (node.count) {
+                        // leaf
+                        for (uint i = node.offset; i < node.offset + node.count; ++i) {
+                            if (RefHit(primitives_[i], ray, tmin, closest, hit)) {
+                                closest = hit.t;
+                                closest_f = RoundUp(closest);
+                                had_hit = true;
+                            }
+                        }
+                    }
+                    else {
+                        // visit the child on the ray's near side first
+                        if (dir_neg[node.axis]) {
+                            stack[top++] = current + 1;
+                            current = node.offset;
+                        }
+                        else {
+                            stack[top++] = node.offset;
+                            current = current + 1;
+                        }
+                        continue;
+                    }
+                }
+                if (!top)
+                    break;
+                current = stack[--top];
+            }
+            return had_hit;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "surface.h"
+
+namespace RT {
+    namespace core {
+
+        class Ray;
+        struct RayHit;
+
+        // Reference to one primitive of a surface (e.g. one face of a
+        // TriMesh), or to the whole surface if primitive is kWholeSurface
+        struct PrimitiveRef {
+            Surface* surface;   // referenced surface (not owned)
+            int primitive;      // primitive index within the surface
+        };
+
+        // Flattened BVH node (depth-first layout: the first child directly
+        // follows its parent). Bounds are stored in single precision,
+        // rounded outwards, which halves the node size (32 bytes).
+        struct PrimitiveBVHNode {
+            float min[3];       // node box min coordinates
+            float max[3];       // node box max coordinates
+            uint offset;        // second child index (inner) or first primitive (leaf)
+            ushort count;       // number of primitives (0 for inner nodes)
+            ushort axis;        // split axis (inner nodes)
+        };
+
+        // BVH over primitive references, built with a binned surface area
+        // heuristic and stored as a flat node array. Traversal runs in
+        // single precision with conservative slab tests (\see
+        // AABB::SlabHitf); primitives are intersected in full precision.
+        // Used to merge the faces of every mesh together with spheres and
+        // triangles into a single scene tree, so rays do not restart
+        // traversal inside each mesh.
+        class PrimitiveBVH : public Surface {
+        public:
+            RT_NODE(PrimitiveBVH)
+
+                explicit PrimitiveBVH(const std::string& name = std::string());
+
+            bool Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit) override;
+
+            AABB GetBoundingBox(bool force_recompute = false) override;
+
+            // Build the tree over the given primitives. owners keeps the
+            // referenced surfaces alive for the lifetime of the tree.
+            bool Build(std::vector<PrimitiveRef> primitives,
+                const std::vector<Surface::Ptr>& owners);
+
+            // Get number of nodes
+            inline size_t GetNodeCount() const { return nodes_.size(); }
+
+            // Get number of referenced primitives
+            inline size_t GetReferenceCount() const { return primitives_.size(); }
+
+            static constexpr int kWholeSurface = -1;   // PrimitiveRef to a whole surface
+            static constexpr int kMaxLeafSize = 4;     // max primitives per leaf
+            static constexpr int kBins = 16;           // SAH split candidates per axis
+            static constexpr int kMaxStackDepth = 64;  // traversal stack size
+            static constexpr int kMedianDepth = 24;    // depth from which splits are median splits
+        protected:
+            // Recursively build the subtree over primitives_[start, end)
+            void BuildNode(size_t start, size_t end, std::vector<uint>& order,
+                const std::vector<AABB>& boxes, const std::vector<Vec3r>& centroids,
+                int depth);
+
+            // Intersect a single primitive reference
+            inline bool RefHit(const PrimitiveRef& ref, const Ray& ray, Real tmin,
+                Real tmax, RayHit& hit) const {
+                return ref.primitive == kWholeSurface ?
+                    ref.surface->Hit(ray, tmin, tmax, hit) :
+                    ref.surface->PrimitiveHit(static_cast<size_t>(ref.primitive), ray,
+                        tmin, tmax, hit);
+            }
+
+            std::vector<PrimitiveBVHNode> nodes_;   // flattened nodes (root is nodes_[0])
+            std::vector<PrimitiveRef> primitives_;  // primitives, in leaf order
+            std::vector<Surface::Ptr> owners_;      // surfaces referenced by primitives_
+        };
+
+    }  // namespace core
+}  // namespace RT
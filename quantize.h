@@ -0,0 +1,105 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "types.h"
+
+namespace RT {
+    namespace core {
+
+        // Convert a float to an IEEE 754 half float (round to nearest;
+        // out-of-range values become infinity, tiny values denormals or zero)
+        inline uint16_t FloatToHalf(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+            uint32_t magnitude = bits & 0x7fffffff;
+            if (magnitude >= 0x7f800000)  // inf or nan
+                return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+            if (magnitude >= 0x477ff000)  // rounds past the largest half
+                return sign | 0x7c00;
+            if (magnitude < 0x38800000) {  // denormal half
+                if (magnitude < 0x33000000)
+                    return sign;
+                uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+                int shift = 126 - static_cast<int>(magnitude >> 23);
+                uint32_t half = mantissa >> shift;
+                uint32_t rest = mantissa & ((1u << shift) - 1);
+                uint32_t halfway = 1u << (shift - 1);
+                if (rest > halfway || (rest == halfway && (half & 1)))
+                    ++half;
+                return sign | static_cast<uint16_t>(half);
+            }
+            // normal: rebias exponent and round the mantissa to 10 bits
+            uint32_t half = (magnitude - 0x38000000) >> 13;
+            uint32_t rest = magnitude & 0x1fff;
+            if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+                ++half;
+            return sign | static_cast<uint16_t>(half);
+        }
+
+        // Convert an IEEE 754 half float to a float (exact)
+        inline float HalfToFloat(uint16_t half)
+        {
+            uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+            uint32_t exponent = (half >> 10) & 0x1f;
+            uint32_t mantissa = half & 0x3ff;
+            uint32_t bits;
+            if (exponent == 0x1f) {
+                bits = sign | 0x7f800000 | (mantissa << 13);
+            }
+            else if (exponent) {
+                bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+            }
+            else {
+                // zero or denormal: value is mantissa * 2^-24
+                float value = std::ldexp(static_cast<float>(mantissa), -24);
+                return sign ? -value : value;
+            }
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        // Encode a unit vector with the octahedral mapping into two signed
+        // 16-bit values (max angular error about 1e-4 radians)
+        inline void OctEncode(const Vec3f& n, int16_t out[2])
+        {
+            float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+            if (!(l1 > 0)) {
+                out[0] = out[1] = 0;
+                return;
+            }
+            float x = n[0] / l1;
+            float y = n[1] / l1;
+            if (n[2] < 0) {
+                // fold the lower hemisphere over the diagonals
+                float fx = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+                float fy = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+                x = fx;
+                y = fy;
+            }
+            out[0] = static_cast<int16_t>(std::lround(CLAMP(x, -1.0f, 1.0f) * 32767.0f));
+            out[1] = static_cast<int16_t>(std::lround(CLAMP(y, -1.0f, 1.0f) * 32767.0f));
+        }
+
+        // Decode an octahedral-encoded unit vector
+        inline Vec3f OctDecode(const int16_t in[2])
+        {
+            float x = in[0] * (1.0f / 32767.0f);
+            float y = in[1] * (1.0f / 32767.0f);
+            float z = 1 - std::abs(x) - std::abs(y);
+            if (z < 0) {
+                float fx = (1 - std::abs(y)) * (x >= 0 ? 1.0f : -1.0f);
+                float fy = (1 - std::abs(x)) * (y >= 0 ? 1.0f : -1.0f);
+                x = fx;
+                y = fy;
+            }
+            Vec3f n{ x, y, z };
+            float length = n.norm();
+            return length > 0 ? Vec3f(n / length) : n;
+        }
+
+    }  // namespace core
+}  // namespace RT
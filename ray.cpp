@@ -1,5 +1,6 @@
 #include "ray.h"
 #include <spdlog/spdlog.h>
+#include "surface.h"
 
 namespace RT {
     namespace core {
@@ -21,5 +22,16 @@ namespace RT {
             SetNormal(ray, face_normal);
         }
 
+
+        void
+            HitRecord::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit)
+        {
+            ray_t_ = hit.t;
+            surface_ = hit.surface;
+            lod_level_ = 0;
+            if (hit.surface)
+                hit.surface->ComputeSurfaceInteraction(ray, hit, *this);
+        }
+
     }  // namespace core
 }  // namespace RT
\ No newline at end of file
@@ -33,6 +33,38 @@ namespace RT {
             // Evaluate ray at fractional distance t
             inline Vec3r At(Real t) const { return origin_ + t * dir_; }
 
+            // Set ray cone: footprint width at the origin and spread angle
+            // (radians); a zero spread means the ray carries no cone
+            inline void SetCone(Real width, Real spread) {
+                cone_width_ = width;
+                cone_spread_ = spread;
+            }
+
+            // Return whether the ray carries a cone footprint
+            inline bool HasCone() const { return cone_spread_ > 0; }
+
+            // Get cone spread angle
+            inline Real GetConeSpread() const { return cone_spread_; }
+
+            // Get cone footprint width at fractional distance t
+            inline Real GetConeWidth(Real t) const {
+                return cone_width_ + cone_spread_ * t * dir_.norm();
+            }
+
+            // Pin the level of detail the ray uses for the surface its origin
+            // lies on (the level that surface was hit at), so secondary and
+            // shadow rays do not hit a finer or coarser version of it
+            inline void SetLod(const Surface* surface, size_t level) {
+                lod_surface_ = surface;
+                lod_level_ = level;
+            }
+
+            // Get surface whose level of detail is pinned, or null
+            inline const Surface* GetLodSurface() const { return lod_surface_; }
+
+            // Get pinned level of detail (0 is the full mesh)
+            inline size_t GetLodLevel() const { return lod_level_; }
+
             // Reflect incoming ray
             static Ray Reflect(const Ray& ray_in, const Vec3r& point, const Vec3r& normal);
 
@@ -46,8 +78,36 @@ namespace RT {
         protected:
             Vec3r origin_{ 0, 0, 0 };  //!< Ray origin
             Vec3r dir_{ 0, 0, 0 };     //!< Ray direction
+            Real cone_width_{ 0 };     //!< cone footprint width at the origin
+            Real cone_spread_{ 0 };    //!< cone spread angle (0: no cone)
+            const Surface* lod_surface_{ nullptr };  //!< surface with pinned LOD level
+            size_t lod_level_{ 0 };    //!< pinned LOD level of lod_surface_
         };
 
+        // Hit found during traversal: only what the closest-hit search needs.
+        // Surfaces' Hit fill this; the shading attributes are computed from
+        // it once, for the closest hit (\see HitRecord::ComputeSurfaceInteraction).
+        struct RayHit {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            // Record a hit (overwriting any farther one)
+            inline void Set(Real ray_t, Surface* hit_surface, int hit_primitive = -1,
+                const Vec2r& hit_barycentrics = Vec2r{ -1, -1 }) {
+                t = ray_t;
+                surface = hit_surface;
+                primitive = hit_primitive;
+                part = 0;
+                barycentrics = hit_barycentrics;
+            }
+
+            Real t{ 0 };                   //!< fractional distance along the ray
+            Surface* surface{ nullptr };   //!< surface that found the hit (non-owning)
+            int primitive{ -1 };           //!< primitive hit within surface (e.g. face), or -1
+            uint part{ 0 };                //!< surface-defined part hit (e.g. LOD level)
+            Vec2r barycentrics{ -1, -1 };  //!< barycentric coordinates within the primitive
+        };
+
+        // Shading attributes of the closest hit
         class HitRecord {
         public:
             EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -79,8 +139,19 @@ namespace RT {
                 front_face_ = front_face;
             }
 
-            // Set surface that was hit
-            inline void SetSurface(std::shared_ptr<Surface> surface) { surface_ = surface; }
+            // Fill the hit attributes of a traversal hit through the surface
+            // that found it
+            void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit);
+
+            // Set surface whose material shades the hit (not owned; the scene
+            // keeps it alive), e.g. a mesh delegating to per-level meshes
+            inline void SetSurface(Surface* surface) { surface_ = surface; }
+
+            // Set level of detail of the surface the hit is on (0: full mesh)
+            inline void SetLodLevel(size_t level) { lod_level_ = level; }
+
+            // Get level of detail of the surface the hit is on
+            inline size_t GetLodLevel() const { return lod_level_; }
 
             // Get ray's fractional distance
             inline Real GetRayT() const { return ray_t_; }
@@ -95,7 +166,7 @@ namespace RT {
             inline bool IsFrontFace() const { return front_face_; }
 
             // Get hit surface
-            inline std::shared_ptr<Surface> GetSurface() const { return surface_; }
+            inline Surface* GetSurface() const { return surface_; }
 
             inline FaceGeoUV GetFaceGeoUV() const { return face_geouv_; }
 
@@ -105,7 +176,8 @@ namespace RT {
             Vec3r point_{ 0, 0, 0 };   //!< hit point
             Vec3r normal_{ 0, 0, 0 };  //!< surface normal at hit point
             bool front_face_{ true };  //!< whether hit point was front or back facing
-            std::shared_ptr<Surface> surface_;  //!< pointer to the hit surface
+            Surface* surface_{ nullptr };  //!< hit surface (non-owning)
+            size_t lod_level_{ 0 };        //!< level of detail of surface_ hit
             FaceGeoUV face_geouv_;  //!< track UV coordinates of intersected point
         };
 
@@ -1,20 +1,25 @@
 #include "raytra_parser.h"
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <spdlog/spdlog.h>
 #include "surface.h"
 #include "sphere.h"
+#include "sphere_batch.h"
 #include "camera.h"
 #include "triangle.h"
+#include "plane.h"
 #include "surface_list.h"
 #include "light.h"
 #include "phong_material.h"
 #include "phong_dielectric.h"
 #include "trimesh.h"
+#include "out_of_core_mesh.h"
 #include "texture.h"
 #include "image_texture.h"
+#include "asset_registry.h"
 
 namespace RT {
     namespace core {
@@ -25,7 +30,8 @@ namespace RT {
 
         bool RaytraParser::ParseFile(const std::string& filename, Surface::Ptr& scene,
             std::vector<Light::Ptr>& lights,
-            Camera::Ptr& camera, Vec2i& image_size, int shadow_samples)
+            Camera::Ptr& camera, Vec2i& image_size, SceneOptions& options,
+            int shadow_samples)
         {
             // get absoulte file path
             fs::path filepath(filename);
@@ -52,10 +58,21 @@ namespace RT {
             int light_count = 0;
             int material_count = 0;
             vector<Surface::Ptr> surfaces;
+            vector<Sphere::Ptr> spheres;
+            // meshes to load once all options are known
+            struct MeshLine {
+                size_t surface;             // index into surfaces
+                fs::path path;              // absolute mesh path
+                string meshpath;            // mesh path as written
+                PhongMaterial::Ptr material;
+            };
+            vector<MeshLine> mesh_lines;
 
             // current material that's applied to the next read surface
             PhongMaterial::Ptr current_material;
             std::map<int, ImageTexture::Ptr> tids{};
+            // meshes and textures referenced more than once are loaded once
+            AssetRegistry assets;
             // parse file
             for (string line; getline(in, line);) {
                 // skip comments and empty lines
@@ -85,7 +102,7 @@ namespace RT {
                         return false;
                     }
                     sphere->SetMaterial(current_material);
-                    surfaces.push_back(sphere);
+                    spheres.push_back(sphere);
                     break;
                 }
                 case 'c':
@@ -177,6 +194,29 @@ namespace RT {
                     surfaces.push_back(triangle);
                     break;
                 }
+                case 'p':
+                {
+                    // infinite plane
+                    Real nx, ny, nz, d;
+                    iss >> nx >> ny >> nz >> d;
+                    Vec3r normal{ nx, ny, nz };
+                    if (!(normal.norm() > 0)) {
+                        spdlog::error("Invalid scene file: plane normal has zero length: {}",
+                            line);
+                        return false;
+                    }
+                    auto plane = Plane::Create(normal, d);
+
+                    // set material
+                    if (!current_material) {
+                        spdlog::error("Invalid scene file: cannot find matching material "
+                            "for surface: {}", line);
+                        return false;
+                    }
+                    plane->SetMaterial(current_material);
+                    surfaces.push_back(plane);
+                    break;
+                }
                 case 'i':
                 {
                     int ti;
@@ -188,7 +228,7 @@ namespace RT {
                     fs::path path(imagepath);
                     path = boost::filesystem::absolute(path,
                         path_prefix);
-                    auto image = ImageTexture::Create(path, flipx, flipy);
+                    auto image = assets.GetImageTexture(path, flipx, flipy);
                     tids[ti] = image;
                     break;
                 }
@@ -222,21 +262,17 @@ namespace RT {
                     iss >> meshpath;
                     fs::path path(meshpath);
                     path = boost::filesystem::absolute(path, path_prefix);
-                    auto trimesh = TriMesh::Create();
                     // set material
                     if (!current_material) {
                         spdlog::error("Invalid scene file: cannot find matching material "
                             "for surface: {}", line);
                         return false;
                     }
-                    if (!trimesh->Load(path))
-                    {
-                        spdlog::error("Cannot read mesh from path {}", meshpath);
-                        return false;
-                    }
-                    trimesh->SetMaterial(current_material);
-                    trimesh->BuildBVH();
-                    surfaces.push_back(trimesh);
+                    // loaded after the whole file is parsed, so the mesh options
+                    // may appear anywhere
+                    mesh_lines.push_back(MeshLine{ surfaces.size(), path, meshpath,
+                        current_material });
+                    surfaces.push_back(nullptr);
                     break;
                 }
                 case 'l':
@@ -278,6 +314,14 @@ namespace RT {
                     }
                     break;
                 }
+                case 'o':
+                {
+                    // options
+                    string option_line;
+                    getline(iss, option_line);
+                    options.ParseLine(option_line);
+                    break;
+                }
 
                 default:
                     continue;
@@ -298,12 +342,100 @@ namespace RT {
                 return false;
             }
 
-            if (surfaces.size() < 1)
+            // load meshes
+            int out_of_core = options.GetInt("out_of_core", 0);
+            int chunk_faces = options.GetInt("ooc_chunk_faces",
+                static_cast<int>(OutOfCoreMesh::kDefaultChunkFaces));
+            bool use_cache = options.GetString("mesh_cache", "on") != "off";
+            bool quantize = options.HasFlag("mesh_quantize");
+            for (const auto& mesh_line : mesh_lines) {
+                if (out_of_core > 0)
+                {
+                    // stream the mesh from disk in chunks
+                    auto ooc_mesh = OutOfCoreMesh::Create();
+                    ooc_mesh->SetMemoryBudget(static_cast<size_t>(out_of_core) << 20);
+                    if (!ooc_mesh->Load(mesh_line.path, static_cast<size_t>(max(chunk_faces, 1))))
+                    {
+                        spdlog::error("Cannot read mesh from path {}", mesh_line.meshpath);
+                        return false;
+                    }
+                    ooc_mesh->SetMaterial(mesh_line.material);
+                    surfaces[mesh_line.surface] = ooc_mesh;
+                    continue;
+                }
+                auto trimesh = assets.GetTriMesh(mesh_line.path, true, use_cache);
+                if (!trimesh)
+                {
+                    spdlog::error("Cannot read mesh from path {}", mesh_line.meshpath);
+                    return false;
+                }
+                // no-op for geometry shared with an already quantized mesh
+                if (quantize)
+                    trimesh->Quantize();
+                trimesh->SetMaterial(mesh_line.material);
+                surfaces[mesh_line.surface] = trimesh;
+            }
+
+            auto surface_count = surfaces.size() + spheres.size();
+            if (surface_count < 1)
                 spdlog::warn("Scene file does not contain any surfaces");
 
+            // levels of detail for meshes, once the camera is known
+            string lod = options.GetString("lod", "off");
+            if (lod == "instance" || lod == "ray") {
+                Real faces_per_pixel = options.GetReal("lod_faces_per_pixel",
+                    TriMesh::kLodFacesPerPixel);
+                // build the levels once per geometry; meshes sharing it
+                // (\see AssetRegistry) share its levels
+                vector<TriMesh::Ptr> lod_meshes;
+                map<const void*, TriMesh::Ptr> lod_sources;
+                for (auto& surface : surfaces) {
+                    auto trimesh = dynamic_pointer_cast<TriMesh>(surface);
+                    if (!trimesh)
+                        continue;
+                    auto& source = lod_sources[trimesh->GetGeometryKey()];
+                    if (!source) {
+                        source = trimesh;
+                        if (!trimesh->BuildLods())
+                            continue;
+                    }
+                    else {
+                        trimesh->ShareLods(*source);
+                        if (trimesh->GetLodCount() < 2)
+                            continue;
+                    }
+                    lod_meshes.push_back(trimesh);
+                }
+                for (auto& trimesh : lod_meshes) {
+                    if (lod == "ray")
+                        trimesh->EnableRayLod();
+                    else
+                        trimesh->SelectLod(*camera, static_cast<uint>(image_size[1]),
+                            faces_per_pixel);
+                }
+            }
+            else if (lod != "off") {
+                spdlog::warn("Unknown lod option {}; expected off, instance or ray", lod);
+            }
+
+            // store spheres in SIMD batches once there are enough of them
+            int sphere_batch = options.GetInt("sphere_batch", 64);
+            if (sphere_batch > 0 && spheres.size() >= static_cast<size_t>(sphere_batch)) {
+                auto batch = SphereBatch::Create(spheres);
+                spdlog::info("Batched {} spheres into {} SIMD batches", spheres.size(),
+                    batch->GetPrimitiveCount());
+                surfaces.push_back(batch);
+            }
+            else {
+                surfaces.insert(surfaces.end(), spheres.begin(), spheres.end());
+            }
+
             scene = SurfaceList::Create(surfaces);
             spdlog::info("Read {} surface(s), {} material(s), & {} point light(s) ",
-                surfaces.size(), material_count, light_count);
+                surface_count, material_count, light_count);
+            if (assets.GetSharedCount())
+                spdlog::info("Shared {} repeated mesh/texture reference(s)",
+                    assets.GetSharedCount());
             return true;
         }
 
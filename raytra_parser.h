@@ -5,6 +5,7 @@
 #include "surface.h"
 #include "camera.h"
 #include "light.h"
+#include "scene_options.h"
 
 namespace RT {
     namespace core {
@@ -13,7 +14,7 @@ namespace RT {
         public:
             static bool ParseFile(const std::string& filename, Surface::Ptr& scene,
                 std::vector<Light::Ptr>& lights, Camera::Ptr& camera,
-                Vec2i& image_size, int shadow_samples);
+                Vec2i& image_size, SceneOptions& options, int shadow_samples);
         };
 
     }  // namespace core
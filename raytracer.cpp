@@ -13,75 +13,114 @@ namespace RT {
         using namespace std;
 
         bool
-            RayTracer::RayColor(const Ray& ray, Surface::Ptr scene,
-                const std::vector<Light::Ptr>& lights, uint ray_depth,
-                uint max_ray_depth, Vec3r& ray_color)
+            RayTracer::RayColor(const Ray& ray, const Surface::Ptr& scene,
+                const Vec3r& weight, size_t slot, uint ray_depth,
+                uint max_ray_depth, ShadingBatch& batch,
+                std::vector<PathVertex>& path_stack)
         {
-            // check for when the ray bounces exceed the limit
-            ray_color = Vec3r{ 0, 0, 0 };
-            if (ray_depth >= max_ray_depth)
-                return false;
-
-            // check whether ray hits any scene object
-            HitRecord hit_record;
-            if (!scene->Hit(ray, kEpsilon, kInfinity, hit_record))
-                return false;
-
-            auto hit_surface = hit_record.GetSurface();
-            if (!hit_surface)
-                return false;
-            auto material = hit_surface->GetMaterial();
-            if (!material) {
-                spdlog::error("RayColor: surface has no material -- returning black.");
-                return true;
-            }
+            // Each iteration traces one ray and pushes its secondary rays.
+            // Depth first, so at most one sibling per bounce is pending and
+            // the stack only fills up if max_ray_depth exceeds its size.
+            PathVertex* stack = path_stack.data();
+            int stack_size = 0;
+            uniform_real_distribution<Real> uniform(0, 1);
+            const Real weight_scale = weight.maxCoeff();
+            auto push = [&](const Ray& next_ray, Vec3r next_weight, uint depth) {
+                if (depth >= max_ray_depth || stack_size >= kPathStackSize)
+                    return;
+                if (roulette_depth_ && depth >= roulette_depth_ && weight_scale > 0) {
+                    // Russian roulette on the path throughput
+                    Real survival = min(Real(1), next_weight.maxCoeff() / weight_scale);
+                    if (!(survival > 0) || uniform(rng_) >= survival)
+                        return;
+                    next_weight /= survival;
+                }
+                stack[stack_size++] = PathVertex{ next_ray, next_weight, depth };
+            };
+            push(ray, weight, ray_depth);
+            bool primary_hit = false;
+
+            while (stack_size) {
+                const PathVertex vertex = stack[--stack_size];
+                const Ray& path_ray = vertex.ray;
+
+                // check whether ray hits any scene object
+                RayHit hit;
+                if (!scene->Hit(path_ray, kEpsilon, kInfinity, hit))
+                    continue;
+                HitRecord hit_record;
+                hit_record.ComputeSurfaceInteraction(path_ray, hit);
+                if (vertex.depth == ray_depth)
+                    primary_hit = true;
+
+                auto hit_surface = hit_record.GetSurface();
+                if (!hit_surface)
+                    continue;
+                auto material = hit_surface->GetMaterialPtr();
+                if (!material) {
+                    spdlog::error("RayColor: surface has no material -- returning black.");
+                    continue;
+                }
 
-            auto phong_material = dynamic_pointer_cast<PhongMaterial>(material);
-            if (phong_material) {
-                auto dielectric = dynamic_pointer_cast<PhongDielectric>(phong_material);
+                // dispatch on the material type tag (no RTTI per hit)
+                auto phong_material = PhongMaterial::Cast(material);
+                if (!phong_material)
+                    continue;
+                // secondary rays continue the cone footprint and stay on the
+                // level of detail of the surface they leave (for mesh LOD)
+                const Real cone_width = path_ray.GetConeWidth(hit_record.GetRayT());
+                auto dielectric = PhongDielectric::Cast(material);
                 if (dielectric) {  // handle glass
-                    shared_ptr<Ray> reflect_ray;
-                    shared_ptr<Ray> refract_ray;
+                    Ray reflect_ray;
+                    Ray refract_ray;
+                    bool refracted;
                     Real schlick_reflectance;
-                    Vec3r attenuate = dielectric->Scatter(hit_record, ray, reflect_ray,
-                        refract_ray, schlick_reflectance);
-                    if (refract_ray) {  // refract
-                        Vec3r refract_color;
-                        if (RayColor(*refract_ray, scene, lights, ray_depth + 1, max_ray_depth,
-                            refract_color)) {
-                            ray_color += attenuate.cwiseProduct(refract_color *
-                                (1.0f - schlick_reflectance));
-                        }
+                    Vec3r attenuate = dielectric->Scatter(hit_record, path_ray, reflect_ray,
+                        refract_ray, refracted, schlick_reflectance);
+                    const Vec3r path_weight = vertex.weight.cwiseProduct(attenuate);
+                    reflect_ray.SetCone(cone_width, path_ray.GetConeSpread());
+                    reflect_ray.SetLod(hit_surface, hit_record.GetLodLevel());
+                    if (refracted) {
+                        refract_ray.SetCone(cone_width, path_ray.GetConeSpread());
+                        refract_ray.SetLod(hit_surface, hit_record.GetLodLevel());
                     }
-
-                    if (reflect_ray) {  // reflect
-                        Vec3r reflect_color;
-                        if (RayColor(*reflect_ray, scene, lights, ray_depth + 1, max_ray_depth,
-                            reflect_color)) {
-                            ray_color += attenuate.cwiseProduct(reflect_color * schlick_reflectance);
+                    if (sample_dielectrics_ && refracted) {
+                        // pick one ray with probability equal to its share of
+                        // the radiance, so the share and probability cancel
+                        if (uniform(rng_) < schlick_reflectance)
+                            push(reflect_ray, path_weight, vertex.depth + 1);
+                        else
+                            push(refract_ray, path_weight, vertex.depth + 1);
+                    }
+                    else {
+                        push(reflect_ray, path_weight * schlick_reflectance, vertex.depth + 1);
+                        if (refracted) {
+                            push(refract_ray, path_weight * (1.0f - schlick_reflectance),
+                                vertex.depth + 1);
                         }
                     }
                 }
                 else {
-                    // compute normal Phong shading
-                    Vec3r view_vec = -ray.GetDirection().normalized();
-                    for (auto light : lights)
-                        ray_color += light->Illuminate(hit_record, view_vec, scene);
+                    // defer Phong shading to the batch
+                    Vec3r view_vec = -path_ray.GetDirection().normalized();
+                    batch.Add(phong_material,
+                        phong_material->GetShadingContext(hit_record, view_vec),
+                        vertex.weight, slot);
 
                     // compute mirror reflections
-                    const auto& v = ray.GetDirection();
+                    const auto& v = path_ray.GetDirection();
                     const auto& n = hit_record.GetNormal();
                     const Vec3r& reflect = v - 2 * v.dot(n) * n;
                     const auto& mirror = phong_material->GetMirror();
                     if (!mirror.isZero() && hit_record.IsFrontFace()) {
-                        Vec3r reflect_color;
-                        if (RayColor(Ray{ hit_record.GetPoint(), reflect }, scene,
-                            lights, ray_depth + 1, max_ray_depth, reflect_color))
-                            ray_color += mirror.cwiseProduct(reflect_color);
+                        Ray reflect_ray{ hit_record.GetPoint(), reflect };
+                        reflect_ray.SetCone(cone_width, path_ray.GetConeSpread());
+                        reflect_ray.SetLod(hit_surface, hit_record.GetLodLevel());
+                        push(reflect_ray, vertex.weight.cwiseProduct(mirror), vertex.depth + 1);
                     }
                 }
             }
-            return true;
+            return primary_hit;
         }
 
 
@@ -117,34 +156,48 @@ namespace RT {
             // send rays
             Real xscale = 1.0 / width;
             Real yscale = 1.0 / height;
+            const Real pixel_spread = camera->GetPixelSpread(static_cast<uint>(height));
+            if (max_ray_depth_ > static_cast<uint>(kPathStackSize))
+                spdlog::warn("RayTracer: max ray depth {} exceeds the path stack size {}, "
+                    "deeper glass paths may be cut short", max_ray_depth_, kPathStackSize);
+
+            // the Phong hits of a row are shaded in batches, grouped by material
+            ShadingBatch batch;
+            // pending rays of the current primary ray, allocated once
+            std::vector<PathVertex> path_stack(kPathStackSize);
+            std::vector<Vec3r> row_colors(static_cast<size_t>(width));
+            const Vec3r sample_weight = Vec3r{ 1, 1, 1 } / samples_per_pixel_;
             for (int y = 0; y < height; ++y) {
+                fill(row_colors.begin(), row_colors.end(), Vec3r{ 0, 0, 0 });
                 for (int x = 0; x < width; ++x) {
                     if (samples_per_pixel_ == 1)
                     {
                         auto ray = camera->GetRay((x + .5) * xscale, (y + .5) * yscale);
-                        Vec3r ray_color;
-                        RayColor(ray, scene, lights, 0, max_ray_depth_, ray_color);
-                        rendered_image_.at<cv::Vec3d>((height - y - 1), x) =
-                            cv::Vec3d{ ray_color[0], ray_color[1], ray_color[2] };
-                        RenderProgressIncDonePixels();
+                        ray.SetCone(0, pixel_spread);
+                        RayColor(ray, scene, sample_weight, x, 0, max_ray_depth_, batch,
+                            path_stack);
                     }
                     else
                     {
-                        Vec3r ray_color;
                         for (int sample = 0; sample < samples_per_pixel_; ++sample)
                         {
                             Real xoffset = RandomReal();  //!< random float in [0, 1)
                             Real yoffset = RandomReal();  //!< random float in [0, 1)
                             auto ray = camera->GetRay((x + xoffset) * xscale, (y + yoffset) * yscale);
-                            Vec3r ray_color_incremental;
-                            RayColor(ray, scene, lights, 0, max_ray_depth_, ray_color_incremental);
-                            ray_color += ray_color_incremental;
+                            ray.SetCone(0, pixel_spread);
+                            RayColor(ray, scene, sample_weight, x, 0, max_ray_depth_, batch,
+                                path_stack);
                         }
-                        ray_color /= samples_per_pixel_;
-                        rendered_image_.at<cv::Vec3d>((height - y - 1), x) =
-                            cv::Vec3d{ ray_color[0], ray_color[1], ray_color[2] };
-                        RenderProgressIncDonePixels();
                     }
+                    if (batch.GetSize() >= kShadingBatchSize)
+                        batch.Shade(lights, scene, row_colors);
+                }
+                batch.Shade(lights, scene, row_colors);
+                for (int x = 0; x < width; ++x) {
+                    const auto& ray_color = row_colors[x];
+                    rendered_image_.at<cv::Vec3d>((height - y - 1), x) =
+                        cv::Vec3d{ ray_color[0], ray_color[1], ray_color[2] };
+                    RenderProgressIncDonePixels();
                 }
             }
 
@@ -3,7 +3,9 @@
 #include <string>
 #include <thread>
 #include <mutex>
+#include <random>
 #include <set>
+#include <vector>
 //#include <tbb.h>
 #include <opencv2/opencv.hpp>
 #include "tqdm.h"
@@ -12,6 +14,7 @@
 #include "surface.h"
 #include "camera.h"
 #include "light.h"
+#include "shading_batch.h"
 
 namespace RT {
     namespace core {
@@ -44,15 +47,45 @@ namespace RT {
             // Set the number of rays per pixel for anti-aliasing
             inline void SetNumSamplesPerPixel(int per_pixel) { samples_per_pixel_ = per_pixel; }
 
+            // Set whether dielectrics trace one of their reflection and
+            // refraction rays, picked with the Schlick reflectance as its
+            // probability (unbiased; converges with samples per pixel),
+            // instead of both
+            inline void SetSampleDielectrics(bool sample) { sample_dielectrics_ = sample; }
+
+            inline bool GetSampleDielectrics() const { return sample_dielectrics_; }
+
+            // Set the bounce from which paths are terminated by Russian
+            // roulette, continuing with probability equal to their throughput
+            // (relative to the primary ray) and reweighted to stay unbiased;
+            // 0 disables it
+            inline void SetRouletteDepth(uint roulette_depth) { roulette_depth_ = roulette_depth; }
+
+            inline uint GetRouletteDepth() const { return roulette_depth_; }
+
             Real inline RandomReal()
             {
                 return std::rand() / RAND_MAX;
             }
         protected:
-            // Determine ray color by intersecting it with the scene
-            bool RayColor(const Ray& ray, Surface::Ptr scene,
-                const std::vector<Light::Ptr>& lights, uint ray_depth,
-                uint max_ray_depth, Vec3r& ray_color);
+            // Ray waiting to be traced in \see RayColor
+            struct PathVertex {
+                Ray ray;          // ray to trace
+                Vec3r weight;     // weight of its radiance (path throughput)
+                uint depth;       // number of bounces so far
+            };
+
+            // Determine ray color by intersecting it with the scene. The direct
+            // lighting of the Phong hits along the ray's paths is added to
+            // batch, scaled by weight and the path's attenuation, for output
+            // color slot (\see ShadingBatch::Shade). Secondary rays are
+            // followed iteratively on path_stack (kPathStackSize vertices,
+            // reused across calls), without recursion or allocations.
+            // return False if the ray hits nothing
+            bool RayColor(const Ray& ray, const Surface::Ptr& scene,
+                const Vec3r& weight, size_t slot, uint ray_depth,
+                uint max_ray_depth, ShadingBatch& batch,
+                std::vector<PathVertex>& path_stack);
 
             // Gamma correct input image
             cv::Mat GammaCorrectImage(const cv::Mat& in_image, Real gamma) const;
@@ -76,6 +109,11 @@ namespace RT {
             cv::Mat rendered_image_;  // output rendered image
             uint max_ray_depth_ = 5;  // max ray depth
             int samples_per_pixel_ = 1;   // samples per pixel (Anti-Aliasing)
+            bool sample_dielectrics_ = false;  // pick one dielectric ray per hit
+            uint roulette_depth_ = 0;  // first bounce with Russian roulette (0: off)
+            std::mt19937 rng_;  // random numbers for path sampling
+            static constexpr size_t kShadingBatchSize = 1024;  // hits shaded per batch
+            static constexpr int kPathStackSize = 64;  // max pending rays per primary ray
 
             // progress bar related data members
             std::mutex progress_bar_mutex_;        // progress bar mutex
@@ -0,0 +1,91 @@
+#include "scene_options.h"
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        void
+            SceneOptions::ParseLine(const std::string& line)
+        {
+            istringstream iss(line);
+            for (string token; iss >> token;) {
+                auto eq = token.find('=');
+                if (eq == string::npos)
+                    Set(token);
+                else
+                    Set(token.substr(0, eq), token.substr(eq + 1));
+            }
+        }
+
+
+        void
+            SceneOptions::Set(const std::string& name, const std::string& value)
+        {
+            if (!name.size())
+                return;
+            options_[name] = value;
+            if (value.size())
+                spdlog::info("Scene option: {}={}", name, value);
+            else
+                spdlog::info("Scene option: {}", name);
+        }
+
+
+        bool
+            SceneOptions::HasFlag(const std::string& name) const
+        {
+            auto it = options_.find(name);
+            if (it == options_.end())
+                return false;
+            const auto& value = it->second;
+            return !(value == "0" || value == "false" || value == "off");
+        }
+
+
+        std::string
+            SceneOptions::GetString(const std::string& name,
+                const std::string& default_value) const
+        {
+            auto it = options_.find(name);
+            if (it == options_.end() || !it->second.size())
+                return default_value;
+            return it->second;
+        }
+
+
+        int
+            SceneOptions::GetInt(const std::string& name, int default_value) const
+        {
+            auto it = options_.find(name);
+            if (it == options_.end())
+                return default_value;
+            try {
+                return stoi(it->second);
+            }
+            catch (...) {
+                spdlog::warn("SceneOptions: option {} expects an integer value", name);
+                return default_value;
+            }
+        }
+
+
+        Real
+            SceneOptions::GetReal(const std::string& name, Real default_value) const
+        {
+            auto it = options_.find(name);
+            if (it == options_.end())
+                return default_value;
+            try {
+                return static_cast<Real>(stod(it->second));
+            }
+            catch (...) {
+                spdlog::warn("SceneOptions: option {} expects a real value", name);
+                return default_value;
+            }
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,44 @@
+#pragma once
+#include <map>
+#include <string>
+#include "types.h"
+
+namespace RT {
+    namespace core {
+
+        // Options read from a scene file's `o` line. Each option is either a
+        // bare flag (e.g. `compress_bvh`) or a key/value pair (e.g. `accel=grid`).
+        class SceneOptions {
+        public:
+            SceneOptions() = default;
+
+            // Parse whitespace-separated options from (the rest of) an `o` line
+            void ParseLine(const std::string& line);
+
+            // Set an option's value (an empty value marks a bare flag)
+            void Set(const std::string& name, const std::string& value = std::string());
+
+            // Return whether an option was given and is not explicitly turned
+            // off (`name=0`, `name=false` or `name=off`)
+            bool HasFlag(const std::string& name) const;
+
+            // Get an option's value, or default_value if it was not given
+            std::string GetString(const std::string& name,
+                const std::string& default_value = std::string()) const;
+
+            // Get an option's value as an integer, or default_value if it was
+            // not given or is not a number
+            int GetInt(const std::string& name, int default_value) const;
+
+            // Get an option's value as a real, or default_value if it was not
+            // given or is not a number
+            Real GetReal(const std::string& name, Real default_value) const;
+
+            // Get all options
+            inline const std::map<std::string, std::string>& GetOptions() const { return options_; }
+        protected:
+            std::map<std::string, std::string> options_;  // option name -> value
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,222 @@
+#include "shading_batch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "surface.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        namespace {
+
+#if defined(__AVX2__)
+            // log2 of positive normal floats (absolute error about 1e-7)
+            inline __m256 Log2(__m256 x)
+            {
+                const __m256i bits = _mm256_castps_si256(x);
+                __m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+                    _mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+                __m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(
+                    _mm256_and_si256(bits, _mm256_set1_epi32(0x7fffff)),
+                    _mm256_set1_epi32(0x3f800000)));
+                // move the mantissa to [sqrt(1/2), sqrt(2)) for fast convergence
+                __m256 big = _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+                mantissa = _mm256_blendv_ps(mantissa,
+                    _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), big);
+                exponent = _mm256_add_ps(exponent, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+                // log(m) = 2 atanh(t), t = (m - 1) / (m + 1)
+                const __m256 one = _mm256_set1_ps(1.0f);
+                __m256 t = _mm256_div_ps(_mm256_sub_ps(mantissa, one),
+                    _mm256_add_ps(mantissa, one));
+                __m256 t2 = _mm256_mul_ps(t, t);
+                __m256 series = _mm256_set1_ps(1.0f / 9);
+                series = _mm256_add_ps(_mm256_mul_ps(series, t2), _mm256_set1_ps(1.0f / 7));
+                series = _mm256_add_ps(_mm256_mul_ps(series, t2), _mm256_set1_ps(1.0f / 5));
+                series = _mm256_add_ps(_mm256_mul_ps(series, t2), _mm256_set1_ps(1.0f / 3));
+                series = _mm256_add_ps(_mm256_mul_ps(series, t2), one);
+                __m256 log2_mantissa = _mm256_mul_ps(_mm256_mul_ps(series, t),
+                    _mm256_set1_ps(2.88539008f));  // 2 / ln 2
+                return _mm256_add_ps(exponent, log2_mantissa);
+            }
+
+            // 2^x (relative error about 2e-7; underflows to zero)
+            inline __m256 Exp2(__m256 x)
+            {
+                x = _mm256_max_ps(x, _mm256_set1_ps(-127.0f));
+                __m256 whole = _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                // exp(f ln 2) for f in [-1/2, 1/2]
+                __m256 y = _mm256_mul_ps(_mm256_sub_ps(x, whole), _mm256_set1_ps(0.693147181f));
+                __m256 series = _mm256_set1_ps(1.0f / 720);
+                series = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f / 120));
+                series = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f / 24));
+                series = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f / 6));
+                series = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(0.5f));
+                series = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f));
+                series = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f));
+                __m256i exponent = _mm256_add_epi32(_mm256_cvtps_epi32(whole),
+                    _mm256_set1_epi32(127));
+                __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23));
+                // 2^-127 is not a normal float: flush it to zero
+                __m256 zero = _mm256_cmp_ps(x, _mm256_set1_ps(-126.5f), _CMP_LT_OQ);
+                return _mm256_andnot_ps(zero, _mm256_mul_ps(series, scale));
+            }
+#endif
+
+            // Compute the Blinn-Phong specular falloff max(0, h.n)^shininess
+            // of kLanes hits sharing a shininess, from structure-of-arrays
+            // unit light, view and normal vectors
+            void SpecularFalloff(const float* light_x, const float* light_y,
+                const float* light_z, const float* view_x, const float* view_y,
+                const float* view_z, const float* normal_x, const float* normal_y,
+                const float* normal_z, float shininess, float* falloff)
+            {
+                const float zero_falloff = pow(0.0f, shininess);
+#if defined(__AVX2__)
+                __m256 hx = _mm256_add_ps(_mm256_loadu_ps(light_x), _mm256_loadu_ps(view_x));
+                __m256 hy = _mm256_add_ps(_mm256_loadu_ps(light_y), _mm256_loadu_ps(view_y));
+                __m256 hz = _mm256_add_ps(_mm256_loadu_ps(light_z), _mm256_loadu_ps(view_z));
+                __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(hx, hx), _mm256_mul_ps(hy, hy)), _mm256_mul_ps(hz, hz)));
+                __m256 dot = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(hx, _mm256_loadu_ps(normal_x)),
+                    _mm256_mul_ps(hy, _mm256_loadu_ps(normal_y))),
+                    _mm256_mul_ps(hz, _mm256_loadu_ps(normal_z)));
+                // cosine of the halfway vector; zero if it is degenerate
+                __m256 cosine = _mm256_div_ps(dot, length);
+                __m256 lit = _mm256_and_ps(
+                    _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ),
+                    _mm256_cmp_ps(cosine, _mm256_set1_ps(1e-30f), _CMP_GT_OQ));
+                cosine = _mm256_blendv_ps(_mm256_set1_ps(1.0f), cosine, lit);
+                __m256 power = Exp2(_mm256_mul_ps(_mm256_set1_ps(shininess), Log2(cosine)));
+                _mm256_storeu_ps(falloff, _mm256_blendv_ps(_mm256_set1_ps(zero_falloff),
+                    power, lit));
+#else
+                for (int lane = 0; lane < ShadingBatch::kLanes; ++lane) {
+                    float hx = light_x[lane] + view_x[lane];
+                    float hy = light_y[lane] + view_y[lane];
+                    float hz = light_z[lane] + view_z[lane];
+                    float length = sqrt(hx * hx + hy * hy + hz * hz);
+                    float cosine = length > 0 ? (hx * normal_x[lane] + hy * normal_y[lane] +
+                        hz * normal_z[lane]) / length : 0;
+                    falloff[lane] = cosine > 0 ? pow(cosine, shininess) : zero_falloff;
+                }
+#endif
+            }
+
+        }  // namespace
+
+
+        void
+            ShadingBatch::Add(const PhongMaterial* material, const ShadingContext& context,
+                const Vec3r& weight, size_t slot)
+        {
+            hits_.push_back(Hit{ material, context, weight, slot });
+        }
+
+
+        void
+            ShadingBatch::Shade(const std::vector<Light::Ptr>& lights,
+                const std::shared_ptr<Surface>& scene, std::vector<Vec3r>& colors)
+        {
+            // group hits by material, so lanes share shininess and specular
+            order_.resize(hits_.size());
+            for (size_t i = 0; i < hits_.size(); ++i)
+                order_[i] = &hits_[i];
+            stable_sort(order_.begin(), order_.end(), [](const Hit* a, const Hit* b) {
+                return less<const PhongMaterial*>()(a->material, b->material);
+            });
+
+            for (size_t first = 0; first < order_.size();) {
+                size_t last = first + 1;
+                while (last < order_.size() && last - first < kLanes &&
+                    order_[last]->material == order_[first]->material)
+                    ++last;
+                ShadeLanes(&order_[first], static_cast<int>(last - first), lights, scene,
+                    colors);
+                first = last;
+            }
+            hits_.clear();
+            order_.clear();
+        }
+
+
+        void
+            ShadingBatch::ShadeLanes(const Hit* const* hits, int count,
+                const std::vector<Light::Ptr>& lights,
+                const std::shared_ptr<Surface>& scene, std::vector<Vec3r>& colors)
+        {
+            // structure-of-arrays view and normal vectors; unused lanes
+            // repeat the first hit
+            float view_x[kLanes], view_y[kLanes], view_z[kLanes];
+            float normal_x[kLanes], normal_y[kLanes], normal_z[kLanes];
+            for (int lane = 0; lane < kLanes; ++lane) {
+                const ShadingContext& context = hits[lane < count ? lane : 0]->context;
+                view_x[lane] = static_cast<float>(context.view_vec[0]);
+                view_y[lane] = static_cast<float>(context.view_vec[1]);
+                view_z[lane] = static_cast<float>(context.view_vec[2]);
+                normal_x[lane] = static_cast<float>(context.normal[0]);
+                normal_y[lane] = static_cast<float>(context.normal[1]);
+                normal_z[lane] = static_cast<float>(context.normal[2]);
+            }
+            const float shininess = static_cast<float>(hits[0]->context.shininess);
+
+            Vec3r radiance[kLanes];
+            for (int lane = 0; lane < count; ++lane)
+                radiance[lane] = Vec3r{ 0, 0, 0 };
+
+            float light_x[kLanes], light_y[kLanes], light_z[kLanes];
+            float falloff[kLanes];
+            Vec3r irradiance[kLanes];
+            bool visible[kLanes];
+            for (const auto& light : lights) {
+                if (light->GetType() == LightType::kAmbient) {
+                    const Vec3r& ambient = static_cast<const AmbientLight*>(light.get())->
+                        GetAmbient();
+                    for (int lane = 0; lane < count; ++lane)
+                        radiance[lane] += ambient.cwiseProduct(hits[lane]->context.ambient);
+                    continue;
+                }
+                const int samples = light->GetSampleCount();
+                if (!samples) {
+                    // lights without samples are shaded one hit at a time
+                    for (int lane = 0; lane < count; ++lane)
+                        radiance[lane] += light->Shade(hits[lane]->context, scene);
+                    continue;
+                }
+                for (int sample = 0; sample < samples; ++sample) {
+                    // shadow tests and irradiance, then the material for all lanes
+                    int visible_count = 0;
+                    for (int lane = 0; lane < kLanes; ++lane) {
+                        Vec3r light_vec{ 0, 0, 0 };
+                        visible[lane] = lane < count && light->SampleIrradiance(
+                            hits[lane]->context, scene, sample, light_vec, irradiance[lane]);
+                        visible_count += visible[lane] ? 1 : 0;
+                        light_x[lane] = static_cast<float>(light_vec[0]);
+                        light_y[lane] = static_cast<float>(light_vec[1]);
+                        light_z[lane] = static_cast<float>(light_vec[2]);
+                    }
+                    if (!visible_count)
+                        continue;
+                    SpecularFalloff(light_x, light_y, light_z, view_x, view_y, view_z,
+                        normal_x, normal_y, normal_z, shininess, falloff);
+                    for (int lane = 0; lane < count; ++lane) {
+                        if (!visible[lane])
+                            continue;
+                        const ShadingContext& context = hits[lane]->context;
+                        radiance[lane] += irradiance[lane].cwiseProduct(
+                            falloff[lane] * context.specular + context.diffuse);
+                    }
+                }
+            }
+
+            for (int lane = 0; lane < count; ++lane)
+                colors[hits[lane]->slot] += hits[lane]->weight.cwiseProduct(radiance[lane]);
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "types.h"
+#include "light.h"
+#include "shading_context.h"
+
+namespace RT {
+    namespace core {
+
+        class PhongMaterial;
+        class Surface;
+
+        // Deferred direct lighting of Phong hits. The ray tracer adds the
+        // shading context of each hit together with the weight its radiance
+        // carries to the image and the output slot (pixel) it belongs to;
+        // \see Shade then groups the hits by material and evaluates the
+        // lights for kLanes hits at a time, with the Blinn-Phong specular
+        // term (halfway vector, dot product and power) computed in single
+        // precision with AVX2 when available. Shadow tests stay per hit.
+        class ShadingBatch {
+        public:
+            // Add a hit to shade
+            // param[in] material Material of the hit (used for grouping)
+            // param[in] context Shading context of the hit
+            // param[in] weight Factor applied to the hit's radiance
+            // param[in] slot Index of the output color the radiance adds to
+            void Add(const PhongMaterial* material, const ShadingContext& context,
+                const Vec3r& weight, size_t slot);
+
+            // Shade all added hits, adding their weighted radiance to
+            // colors[slot], and clear the batch
+            void Shade(const std::vector<Light::Ptr>& lights,
+                const std::shared_ptr<Surface>& scene, std::vector<Vec3r>& colors);
+
+            inline size_t GetSize() const { return hits_.size(); }
+
+            inline bool IsEmpty() const { return hits_.empty(); }
+
+            static constexpr int kLanes = 8;  // hits per SIMD evaluation
+        protected:
+            struct Hit {
+                const PhongMaterial* material;
+                ShadingContext context;
+                Vec3r weight;
+                size_t slot;
+            };
+
+            // Shade up to kLanes hits of the same material
+            void ShadeLanes(const Hit* const* hits, int count,
+                const std::vector<Light::Ptr>& lights,
+                const std::shared_ptr<Surface>& scene, std::vector<Vec3r>& colors);
+
+            std::vector<Hit> hits_;
+            std::vector<const Hit*> order_;  // hits sorted by material
+        };
+
+    }  // namespace core
+}  // namespace RT
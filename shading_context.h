@@ -0,0 +1,33 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "types.h"
+
+namespace RT {
+    namespace core {
+
+        class Surface;
+
+        // Shading inputs of one hit point, resolved once per hit (texture
+        // lookups included) and shared by every light and light sample
+        struct ShadingContext {
+            Vec3r point{ 0, 0, 0 };      // hit point
+            Vec3r normal{ 0, 0, 0 };     // unit shading normal
+            Vec3r view_vec{ 0, 0, 0 };   // unit vector pointing away from the surface
+            Vec3r ambient{ 0, 0, 0 };    // ambient coefficients
+            Vec3r diffuse{ 0, 0, 0 };    // diffuse albedo
+            Vec3r specular{ 0, 0, 0 };   // specular coefficients (zero on back faces)
+            Real shininess{ 1 };         // specular exponent
+            const Surface* surface{ nullptr };  // surface hit (for shadow ray LOD)
+            size_t lod_level{ 0 };       // level of detail of the surface hit
+
+            // Evaluate the Blinn-Phong reflectance for a unit light vector
+            inline Vec3r Evaluate(const Vec3r& light_vec) const {
+                Vec3r half = (view_vec + light_vec).normalized();
+                Real half_dot = std::max(Real(0), half.dot(normal));
+                return std::pow(half_dot, shininess) * specular + diffuse;
+            }
+        };
+
+    }  // namespace core
+}  // namespace RT
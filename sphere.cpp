@@ -55,10 +55,21 @@ namespace RT {
 
 
         bool
-            Sphere::Hit(const Ray& ray, Real tmin, Real tmax, HitRecord& hit_record)
+            Sphere::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
         {
-            auto p0 = ray.GetOrigin() - center_;
-            auto v = ray.GetDirection();
+            Real t;
+            if (!Intersect(ray, tmin, tmax, t))
+                return false;
+            hit.Set(t, this);
+            return true;
+        }
+
+
+        bool
+            Sphere::Intersect(const Ray& ray, Real tmin, Real tmax, Real& ray_t) const
+        {
+            const Vec3r p0 = ray.GetOrigin() - center_;
+            const Vec3r& v = ray.GetDirection();
             auto a = v.squaredNorm();
             auto b = 2 * p0.dot(v);
             auto c = p0.squaredNorm() - radius_ * radius_;
@@ -74,13 +85,18 @@ namespace RT {
                 t = (-b + s) / a2;
             if (t < tmin || t > tmax)
                 return false;
+            ray_t = t;
+            return true;
+        }
 
-            // fill hit record
-            const Vec3r& hit_point = ray.At(t);
-            hit_record.SetRayT(t);
+
+        void
+            Sphere::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record)
+        {
+            const Vec3r hit_point = ray.At(hit.t);
             hit_record.SetPoint(hit_point);
             hit_record.SetNormal(ray, (hit_point - center_).normalized());
-            hit_record.SetSurface(GetPtr());
             FaceGeoUV face_geouv;
             face_geouv.SetFaceID(-1);
             face_geouv.SetUV(Vec2r{ -1,-1 });
@@ -94,8 +110,6 @@ namespace RT {
             Vec2r uv{ phi / k2Pi, theta / kPi };
             face_geouv.SetGlobalUV(uv);
             hit_record.SetFaceGeoUV(face_geouv);
-            return true;
-
         }
 
     }  // namespace core
@@ -17,6 +17,12 @@ namespace RT {
                 const std::string& name = std::string());
 
             bool Hit(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            // Compute ray parameter of the closest hit in [tmin, tmax]
+            bool Intersect(const Ray& ray, Real tmin, Real tmax, Real& ray_t) const;
+
+            void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
                 HitRecord& hit_record) override;
 
             void SetCenter(const Vec3r& center);
@@ -0,0 +1,259 @@
+#include "sphere_batch.h"
+#include <cmath>
+#include <limits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <spdlog/spdlog.h>
+#include "ray.h"
+#include "morton.h"
+#include "primitive_bvh.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        namespace {
+
+            // relative error bound of the single-precision closest point
+            // computation, used to inflate radii in the candidate test
+            constexpr float kSphereGamma = 16 * std::numeric_limits<float>::epsilon();
+
+        }  // namespace
+
+
+        SphereBatch::SphereBatch(const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "SphereBatch";
+        }
+
+
+        SphereBatch::SphereBatch(const std::vector<Sphere::Ptr>& spheres,
+            const std::string& name) :
+            Surface{}
+        {
+            name_ = name.size() ? name : "SphereBatch";
+            SetSpheres(spheres);
+        }
+
+
+        void
+            SphereBatch::SetSpheres(const std::vector<Sphere::Ptr>& spheres)
+        {
+            spheres_.clear();
+            for (const auto& sphere : spheres) {
+                if (sphere)
+                    spheres_.push_back(sphere);
+            }
+
+            // order spheres along a Morton curve through their centers so
+            // that consecutive spheres (and thus batches) are close together
+            vector<Vec3r> centers(spheres_.size());
+            for (size_t i = 0; i < spheres_.size(); ++i)
+                centers[i] = spheres_[i]->GetCenter();
+            auto order = MortonOrder(centers);
+            vector<Sphere::Ptr> sorted;
+            sorted.reserve(spheres_.size());
+            for (auto i : order)
+                sorted.push_back(spheres_[i]);
+            spheres_.swap(sorted);
+
+            // fill the arrays; padding lanes get a NaN center so they never hit
+            auto batch_count = (spheres_.size() + kBatchSize - 1) / kBatchSize;
+            auto padded_size = batch_count * kBatchSize;
+            const float nan = numeric_limits<float>::quiet_NaN();
+            center_x_.assign(padded_size, nan);
+            center_y_.assign(padded_size, nan);
+            center_z_.assign(padded_size, nan);
+            radius_.assign(padded_size, 0);
+            bboxes_.assign(batch_count, AABB{});
+            for (size_t i = 0; i < spheres_.size(); ++i) {
+                // the radius also covers the rounding of the center
+                const Vec3r center = spheres_[i]->GetCenter();
+                Real radius = fabs(spheres_[i]->GetRadius());
+                Real center_error = 0;
+                for (int k = 0; k < 3; ++k)
+                    center_error += fabs(center[k] - static_cast<float>(center[k]));
+                center_x_[i] = static_cast<float>(center[0]);
+                center_y_[i] = static_cast<float>(center[1]);
+                center_z_[i] = static_cast<float>(center[2]);
+                radius_[i] = RoundUp(radius + center_error);
+                bboxes_[i / kBatchSize].ExpandBy(spheres_[i]->GetBoundingBox());
+            }
+            bvh_ = nullptr;
+            bound_dirty_ = true;
+        }
+
+
+        AABB
+            SphereBatch::GetBoundingBox(bool force_recompute)
+        {
+            // if bound is clean, just return existing bbox_
+            if (!force_recompute && !IsBoundDirty())
+                return bbox_;
+
+            bbox_.Reset();
+            for (const auto& box : bboxes_)
+                bbox_.ExpandBy(box);
+            bound_dirty_ = false;
+            return bbox_;
+        }
+
+
+        AABB
+            SphereBatch::GetPrimitiveBoundingBox(size_t primitive)
+        {
+            return bboxes_[primitive];
+        }
+
+
+        void
+            SphereBatch::BuildBVH()
+        {
+            vector<PrimitiveRef> primitives;
+            primitives.reserve(bboxes_.size());
+            for (size_t i = 0; i < bboxes_.size(); ++i)
+                primitives.push_back(PrimitiveRef{ this, static_cast<int>(i) });
+
+            // the tree references this batch, so it must not own it
+            auto bvh = PrimitiveBVH::Create(GetName());
+            if (bvh->Build(move(primitives), vector<Surface::Ptr>()))
+                bvh_ = bvh;
+        }
+
+
+        int
+            SphereBatch::HitBatch(size_t batch, const Ray& ray, Real tmin, Real tmax,
+                Real& ray_t) const
+        {
+            // candidate test in single precision: with p0 = origin - center,
+            // the closest point of the ray line to the center is at
+            // tc = -p0.v / |v|^2, at distance |f| = |p0 + tc v|; the ray
+            // hits the sphere for t in tc -/+ sqrt((r^2 - |f|^2) / |v|^2).
+            // Radii are inflated by the float rounding errors so that no hit
+            // is missed.
+            const Vec3r& origin = ray.GetOrigin();
+            const Vec3r& dir = ray.GetDirection();
+            const float ox = static_cast<float>(origin[0]);
+            const float oy = static_cast<float>(origin[1]);
+            const float oz = static_cast<float>(origin[2]);
+            const float origin_error = RoundUp(fabs(origin[0] - ox) + fabs(origin[1] - oy) +
+                fabs(origin[2] - oz));
+            const float dx = static_cast<float>(dir[0]);
+            const float dy = static_cast<float>(dir[1]);
+            const float dz = static_cast<float>(dir[2]);
+            const float inv_a = 1 / (dx * dx + dy * dy + dz * dz);
+            const float tmin_f = RoundDown(tmin);
+            const float tmax_f = RoundUp(tmax);
+            const size_t first = batch * kBatchSize;
+            int candidates = 0;
+
+#if defined(__AVX2__)
+            const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+            const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy),
+                vdz = _mm256_set1_ps(dz);
+            __m256 px = _mm256_sub_ps(_mm256_set1_ps(ox), _mm256_loadu_ps(&center_x_[first]));
+            __m256 py = _mm256_sub_ps(_mm256_set1_ps(oy), _mm256_loadu_ps(&center_y_[first]));
+            __m256 pz = _mm256_sub_ps(_mm256_set1_ps(oz), _mm256_loadu_ps(&center_z_[first]));
+            __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, vdx), _mm256_mul_ps(py, vdy)),
+                _mm256_mul_ps(pz, vdz));
+            __m256 tc = _mm256_mul_ps(b, _mm256_set1_ps(-inv_a));
+            __m256 fx = _mm256_add_ps(_mm256_mul_ps(tc, vdx), px);
+            __m256 fy = _mm256_add_ps(_mm256_mul_ps(tc, vdy), py);
+            __m256 fz = _mm256_add_ps(_mm256_mul_ps(tc, vdz), pz);
+            __m256 f2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fy, fy)),
+                _mm256_mul_ps(fz, fz));
+            __m256 p_norm = _mm256_add_ps(_mm256_add_ps(_mm256_and_ps(px, abs_mask),
+                _mm256_and_ps(py, abs_mask)), _mm256_and_ps(pz, abs_mask));
+            __m256 r = _mm256_add_ps(_mm256_loadu_ps(&radius_[first]),
+                _mm256_add_ps(_mm256_mul_ps(p_norm, _mm256_set1_ps(kSphereGamma)),
+                    _mm256_set1_ps(origin_error)));
+            __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(r, r), f2);
+            __m256 valid = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+            __m256 w = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_and_ps(discriminant, valid),
+                _mm256_set1_ps(inv_a)));
+            __m256 slack = _mm256_mul_ps(_mm256_and_ps(tc, abs_mask),
+                _mm256_set1_ps(kCandidateSlack));
+            __m256 t_far = _mm256_add_ps(_mm256_add_ps(tc, w), slack);
+            __m256 t_near = _mm256_sub_ps(_mm256_sub_ps(tc, w), slack);
+            valid = _mm256_and_ps(valid, _mm256_and_ps(
+                _mm256_cmp_ps(t_far, _mm256_set1_ps(tmin_f), _CMP_GE_OQ),
+                _mm256_cmp_ps(t_near, _mm256_set1_ps(tmax_f), _CMP_LE_OQ)));
+            candidates = _mm256_movemask_ps(valid);
+#else
+            for (int lane = 0; lane < kBatchSize; ++lane) {
+                float px = ox - center_x_[first + lane];
+                float py = oy - center_y_[first + lane];
+                float pz = oz - center_z_[first + lane];
+                float tc = -(px * dx + py * dy + pz * dz) * inv_a;
+                float fx = px + tc * dx;
+                float fy = py + tc * dy;
+                float fz = pz + tc * dz;
+                float r = radius_[first + lane] +
+                    (fabs(px) + fabs(py) + fabs(pz)) * kSphereGamma + origin_error;
+                float discriminant = r * r - (fx * fx + fy * fy + fz * fz);
+                if (!(discriminant >= 0))
+                    continue;
+                float w = sqrt(discriminant * inv_a);
+                float slack = fabs(tc) * kCandidateSlack;
+                if (tc + w + slack >= tmin_f && tc - w - slack <= tmax_f)
+                    candidates |= 1 << lane;
+            }
+#endif
+
+            // full precision hits of the candidates
+            int closest = -1;
+            for (int lane = 0; candidates; ++lane, candidates >>= 1) {
+                Real t;
+                if ((candidates & 1) && spheres_[first + lane]->Intersect(ray, tmin, tmax, t)) {
+                    closest = static_cast<int>(first) + lane;
+                    tmax = t;
+                }
+            }
+            if (closest >= 0)
+                ray_t = tmax;
+            return closest;
+        }
+
+
+        bool
+            SphereBatch::PrimitiveHit(size_t primitive, const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit)
+        {
+            Real ray_t;
+            int index = HitBatch(primitive, ray, tmin, tmax, ray_t);
+            if (index < 0)
+                return false;
+            hit.Set(ray_t, spheres_[index].get());
+            return true;
+        }
+
+
+        bool
+            SphereBatch::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            if (bvh_)
+                return bvh_->Hit(ray, tmin, tmax, hit);
+
+            // find the closest sphere over all batches before recording the
+            // hit
+            int closest = -1;
+            Real closest_t = tmax;
+            for (size_t batch = 0; batch < bboxes_.size(); ++batch) {
+                Real ray_t;
+                int index = HitBatch(batch, ray, tmin, closest_t, ray_t);
+                if (index >= 0) {
+                    closest = index;
+                    closest_t = ray_t;
+                }
+            }
+            if (closest < 0)
+                return false;
+            hit.Set(closest_t, spheres_[closest].get());
+            return true;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,74 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "sphere.h"
+
+namespace RT {
+    namespace core {
+
+        class Ray;
+        struct RayHit;
+
+        // Set of spheres stored in structure-of-arrays form (center x/y/z
+        // and radius arrays) and intersected kBatchSize at a time with AVX2
+        // when available. Spheres are grouped along a Morton curve so that
+        // each batch is spatially compact; batches are the primitives of the
+        // surface (\see Surface::GetPrimitiveCount), so they can be placed in
+        // the leaves of a scene-wide \see PrimitiveBVH. The arrays are
+        // single precision and the batch test is conservative: it only
+        // selects candidate spheres, whose hits are then computed in full
+        // precision. Normals and uvs are only computed for the closest hit.
+        class SphereBatch : public Surface {
+        public:
+            RT_NODE(SphereBatch)
+
+                explicit SphereBatch(const std::string& name = std::string());
+
+            SphereBatch(const std::vector<Sphere::Ptr>& spheres,
+                const std::string& name = std::string());
+
+            bool Hit(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            AABB GetBoundingBox(bool force_recompute = false) override;
+
+            size_t GetPrimitiveCount() const override { return bboxes_.size(); }
+
+            AABB GetPrimitiveBoundingBox(size_t primitive) override;
+
+            bool PrimitiveHit(size_t primitive, const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            // Set spheres (reordered into spatially coherent batches)
+            void SetSpheres(const std::vector<Sphere::Ptr>& spheres);
+
+            // Get number of spheres
+            inline size_t GetSphereCount() const { return spheres_.size(); }
+
+            // Build a BVH over the batches, used when the batch is not
+            // flattened into the scene BVH
+            void BuildBVH();
+
+            // Return whether the batch BVH has been built
+            bool HasBVH() const { return bvh_ != nullptr; }
+
+            static constexpr int kBatchSize = 8;  // spheres per batch (SIMD lanes)
+            static constexpr float kCandidateSlack = 1e-4f;  // relative t slack of candidates
+        protected:
+            // Intersect ray with the spheres of one batch
+            // return Index (into spheres_) of the closest hit sphere, or -1
+            int HitBatch(size_t batch, const Ray& ray, Real tmin, Real tmax,
+                Real& ray_t) const;
+
+            std::vector<Sphere::Ptr> spheres_;  //!< spheres, in batch order
+            std::vector<float> center_x_;       //!< center x coordinates (padded)
+            std::vector<float> center_y_;       //!< center y coordinates (padded)
+            std::vector<float> center_z_;       //!< center z coordinates (padded)
+            std::vector<float> radius_;         //!< radii, rounded up (padded)
+            std::vector<AABB> bboxes_;          //!< bounding box of each batch
+            Surface::Ptr bvh_{ nullptr };       //!< BVH over batches
+        };
+
+    }  // namespace core
+}  // namespace RT
@@ -27,17 +27,40 @@ namespace RT {
 
 
 		bool
-			Surface::Hit(const Ray&, Real, Real, HitRecord&)
+			Surface::Hit(const Ray&, Real, Real, RayHit&)
 		{
 			return false;
 		}
 
 
+		void
+			Surface::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+				HitRecord& hit_record)
+		{
+			hit_record.SetPoint(ray.At(hit.t));
+		}
+
+
 		AABB
 			Surface::GetBoundingBox(bool /*force_recompute*/)
 		{
 			return bbox_;
 		}
 
+
+		AABB
+			Surface::GetPrimitiveBoundingBox(size_t /*primitive*/)
+		{
+			return GetBoundingBox();
+		}
+
+
+		bool
+			Surface::PrimitiveHit(size_t /*primitive*/, const Ray& ray, Real tmin,
+				Real tmax, RayHit& hit)
+		{
+			return Hit(ray, tmin, tmax, hit);
+		}
+
 	}  // namespace core
 }  // namespace RT
@@ -9,6 +9,7 @@ namespace RT {
     namespace core {
 
         class Ray;
+        struct RayHit;
         class HitRecord;
         class Material;
 
@@ -18,13 +19,21 @@ namespace RT {
 
                 explicit Surface(const std::string& name = std::string());
 
-            virtual bool Hit(const Ray& ray, Real tmin, Real tmax,
+            // Find the closest hit in [tmin, tmax]; only records the hit
+            // (\see RayHit) and leaves hit untouched if there is none
+            virtual bool Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit);
+
+            // Compute point, normal and uv of a hit this surface recorded
+            virtual void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
                 HitRecord& hit_record);
 
             virtual void SetMaterial(std::shared_ptr<Material> material);
 
             virtual std::shared_ptr<Material> GetMaterial();
 
+            // Get material without sharing ownership (per-hit shading)
+            inline Material* GetMaterialPtr() const { return material_.get(); }
+
             virtual void SetBoundingBox(const AABB& bbox) { bbox_ = bbox; }
 
             virtual void SetBoundDirty(bool dirty) { bound_dirty_ = dirty; }
@@ -32,6 +41,25 @@ namespace RT {
             virtual AABB GetBoundingBox(bool force_recompute = false);
 
             virtual bool IsBoundDirty() const { return bound_dirty_; }
+
+            // Return whether the surface has a finite bounding box; unbounded
+            // surfaces are kept out of acceleration structures
+            virtual bool IsBounded() const { return true; }
+
+            // Get number of primitives (e.g. mesh faces) the surface can be
+            // split into when flattened into a scene-wide BVH
+            virtual size_t GetPrimitiveCount() const { return 1; }
+
+            // Get identity of the surface's geometry: surfaces sharing their
+            // geometry (e.g. copies of a mesh) return the same key
+            virtual const void* GetGeometryKey() const { return this; }
+
+            // Get bounding box of a single primitive
+            virtual AABB GetPrimitiveBoundingBox(size_t primitive);
+
+            // Intersect ray with a single primitive
+            virtual bool PrimitiveHit(size_t primitive, const Ray& ray, Real tmin,
+                Real tmax, RayHit& hit);
         protected:
             std::shared_ptr<Material> material_; // node material
             AABB bbox_;  // surface's axis-aligned bounding box
@@ -36,31 +36,17 @@ namespace RT {
 
 
         bool
-            SurfaceList::Hit(const Ray& ray, Real tmin, Real tmax, HitRecord& hit_record)
+            SurfaceList::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
         {
-            bool first_hit = true;
-            for (size_t i = 0; i < surfaces_.size(); ++i) {
-                auto surface = surfaces_[i];
-                if (!surface)
-                    continue;
-
-                // check for hit
-                HitRecord current_hit;
-                if (!surface->Hit(ray, tmin, tmax, current_hit))
-                    continue;
-
-                // update closest hit record
-                if (first_hit) {
-                    hit_record = current_hit;
-                    first_hit = false;
-                    tmax = current_hit.GetRayT();
-                    continue;
+            bool had_hit = false;
+            for (const auto& surface : surfaces_) {
+                // a hit is closer than any earlier one, as tmax shrinks
+                if (surface && surface->Hit(ray, tmin, tmax, hit)) {
+                    had_hit = true;
+                    tmax = hit.t;
                 }
-                hit_record = current_hit;
-                tmax = current_hit.GetRayT();
             }
-
-            return !first_hit;
+            return had_hit;
         }
 
     }  // namespace core
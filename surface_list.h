@@ -8,7 +8,7 @@ namespace RT {
     namespace core {
 
         class Ray;
-        class HitRecord;
+        struct RayHit;
 
         class SurfaceList : public Surface {
         public:
@@ -18,7 +18,7 @@ namespace RT {
                     const std::string& name = std::string());
 
             bool Hit(const Ray& ray, Real tmin, Real tmax,
-                HitRecord& hit_record) override;
+                RayHit& hit) override;
 
             AABB GetBoundingBox(bool force_recompute = false) override;
 
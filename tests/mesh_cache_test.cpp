@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <fstream>
+#include <catch.hpp>
+#include "mesh_cache.h"
+#include "test_util.h"
+
+using namespace RT::core;
+using RT::test::TempDir;
+namespace fs = boost::filesystem;
+
+namespace {
+
+    // byte offsets of header fields (\see MeshCacheHeader in mesh_cache.cpp)
+    constexpr std::streamoff kVersionOffset = 8;
+    constexpr std::streamoff kIndicesOffsetOffset = 88;
+
+    // A unit square of two faces
+    FlatMesh MakeSquare()
+    {
+        FlatMesh mesh;
+        mesh.Resize(4, 2, false, false);
+        mesh.SetPosition(0, Vec3r(0, 0, 0));
+        mesh.SetPosition(1, Vec3r(1, 0, 0));
+        mesh.SetPosition(2, Vec3r(1, 1, 0));
+        mesh.SetPosition(3, Vec3r(0, 1, 0));
+        mesh.SetFace(0, 0, 1, 2);
+        mesh.SetFace(1, 0, 2, 3);
+        return mesh;
+    }
+
+    template <typename T>
+    T ReadAt(const fs::path& filepath, std::streamoff offset)
+    {
+        T value{};
+        std::ifstream in(filepath.string(), std::ios::binary);
+        in.seekg(offset);
+        in.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+
+    template <typename T>
+    void WriteAt(const fs::path& filepath, std::streamoff offset, const T& value)
+    {
+        std::fstream out(filepath.string(), std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(offset);
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+}  // namespace
+
+
+TEST_CASE("MeshCache round trip", "[MeshCache]")
+{
+    TempDir dir;
+    auto source = dir.Write("square.obj", "placeholder source\n");
+    REQUIRE(MeshCache::Save(source, false, MakeSquare()));
+
+    FlatMesh mesh;
+    AABB bbox;
+    REQUIRE(MeshCache::Load(source, false, mesh, bbox));
+    CHECK(mesh.GetVertexCount() == 4);
+    CHECK(mesh.GetFaceCount() == 2);
+    CHECK(mesh.GetPosition(2) == Vec3r(1, 1, 0));
+    const uint* face = mesh.GetFace(1);
+    CHECK((face[0] == 0 && face[1] == 2 && face[2] == 3));
+
+    // a touched but unchanged source keeps the cache valid
+    fs::last_write_time(source, fs::last_write_time(source) + 10);
+    FlatMesh touched;
+    CHECK(MeshCache::Load(source, false, touched, bbox));
+
+    // the reorder flag must match
+    FlatMesh reordered;
+    CHECK_FALSE(MeshCache::Load(source, true, reordered, bbox));
+}
+
+
+TEST_CASE("MeshCache rejects invalid caches", "[MeshCache]")
+{
+    TempDir dir;
+    auto source = dir.Write("square.obj", "placeholder source\n");
+    REQUIRE(MeshCache::Save(source, false, MakeSquare()));
+    auto cache_path = MeshCache::GetCachePath(source);
+    auto cache_size = fs::file_size(cache_path);
+
+    FlatMesh mesh;
+    AABB bbox;
+    SECTION("truncated file") {
+        fs::resize_file(cache_path, cache_size - 4);
+        CHECK_FALSE(MeshCache::Load(source, false, mesh, bbox));
+    }
+    SECTION("truncated header") {
+        fs::resize_file(cache_path, 16);
+        CHECK_FALSE(MeshCache::Load(source, false, mesh, bbox));
+    }
+    SECTION("wrong version") {
+        WriteAt<uint32_t>(cache_path, kVersionOffset, MeshCache::kVersion + 1);
+        CHECK_FALSE(MeshCache::Load(source, false, mesh, bbox));
+    }
+    SECTION("out-of-range index") {
+        auto indices_offset = ReadAt<uint64_t>(cache_path, kIndicesOffsetOffset);
+        REQUIRE(indices_offset % MeshCache::kAlignment == 0);
+        REQUIRE(indices_offset < cache_size);
+        auto last_corner = static_cast<std::streamoff>(indices_offset + 5 * sizeof(uint));
+        WriteAt<uint>(cache_path, last_corner, 4);
+        CHECK_FALSE(MeshCache::Load(source, false, mesh, bbox));
+    }
+    SECTION("changed source size") {
+        dir.Write("square.obj", "changed source\n");
+        CHECK_FALSE(MeshCache::Load(source, false, mesh, bbox));
+    }
+    SECTION("changed source contents") {
+        auto mtime = fs::last_write_time(source);
+        dir.Write("square.obj", "placeholder SOURCE\n");
+        fs::last_write_time(source, mtime + 10);
+        CHECK_FALSE(MeshCache::Load(source, false, mesh, bbox));
+    }
+    CHECK(mesh.IsEmpty());
+}
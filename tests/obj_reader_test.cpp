@@ -0,0 +1,166 @@
+#include <vector>
+#include <catch.hpp>
+#include "obj_reader.h"
+#include "test_util.h"
+
+using namespace RT::core;
+using RT::test::TempDir;
+
+namespace {
+
+    const char kTriangle[] =
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "v 0 1 0\n";
+
+    // Records the elements passed by ObjReader::Scan
+    class RecordingVisitor : public ObjVisitor {
+    public:
+        void Position(const float* xyz) override {
+            positions.insert(positions.end(), xyz, xyz + 3);
+        }
+        void Triangle(const long long* corners) override {
+            triangles.insert(triangles.end(), corners, corners + 9);
+        }
+
+        std::vector<float> positions;
+        std::vector<long long> triangles;
+    };
+
+}  // namespace
+
+
+TEST_CASE("ObjReader reads absolute and relative indices", "[ObjReader]")
+{
+    TempDir dir;
+    FlatMesh mesh;
+    auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+        "f 1 2 3\n"
+        "v 1 1 0\n"
+        "f -3 -2 -1\n");
+    REQUIRE(ObjReader::Read(filepath, mesh));
+    REQUIRE(mesh.GetVertexCount() == 4);
+    REQUIRE(mesh.GetFaceCount() == 2);
+    const uint* face = mesh.GetFace(0);
+    CHECK((face[0] == 0 && face[1] == 1 && face[2] == 2));
+    face = mesh.GetFace(1);
+    CHECK((face[0] == 1 && face[1] == 2 && face[2] == 3));
+    CHECK(mesh.GetPosition(3) == Vec3r(1, 1, 0));
+}
+
+
+TEST_CASE("ObjReader triangulates polygons", "[ObjReader]")
+{
+    TempDir dir;
+    FlatMesh mesh;
+    auto filepath = dir.Write("mesh.obj", std::string(kTriangle) + "v 1 1 0\nf 1 2 4 3\n");
+    REQUIRE(ObjReader::Read(filepath, mesh));
+    CHECK(mesh.GetFaceCount() == 2);
+}
+
+
+TEST_CASE("ObjReader reads v//vn corners", "[ObjReader]")
+{
+    TempDir dir;
+    FlatMesh mesh;
+    auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+        "vn 0 0 1\n"
+        "f 1//1 2//1 3//-1\n");
+    REQUIRE(ObjReader::Read(filepath, mesh));
+    REQUIRE(mesh.GetVertexCount() == 3);
+    REQUIRE(mesh.GetFaceCount() == 1);
+    CHECK(mesh.HasNormals());
+    CHECK_FALSE(mesh.HasTexCoords());
+    for (uint v = 0; v < 3; ++v) {
+        CHECK(mesh.GetNormal(v) == Vec3r(0, 0, 1));
+        CHECK(mesh.GetPosition(mesh.GetFace(0)[v]) == mesh.GetPosition(v));
+    }
+}
+
+
+TEST_CASE("ObjReader splits vertices with distinct attributes", "[ObjReader]")
+{
+    TempDir dir;
+    FlatMesh mesh;
+    auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+        "vt 0 0\n"
+        "vt 1 1\n"
+        "f 1/1 2/1 3/1\n"
+        "f 1/2 3/2 2/2\n");
+    REQUIRE(ObjReader::Read(filepath, mesh));
+    CHECK(mesh.GetVertexCount() == 6);
+    CHECK(mesh.HasTexCoords());
+    CHECK(mesh.GetTexCoord(mesh.GetFace(1)[0]) == Vec2r(1, 1));
+}
+
+
+TEST_CASE("ObjReader skips malformed lines", "[ObjReader]")
+{
+    TempDir dir;
+    FlatMesh mesh;
+    auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+        "# comment\n"
+        "v x y z\n"
+        "f 1 x 3\n"
+        "f 0 1 2\n"
+        "usemtl default\n"
+        "f 1 2 3\n");
+    REQUIRE(ObjReader::Read(filepath, mesh));
+    CHECK(mesh.GetVertexCount() == 3);
+    CHECK(mesh.GetFaceCount() == 1);
+}
+
+
+TEST_CASE("ObjReader rejects invalid indices", "[ObjReader]")
+{
+    TempDir dir;
+    FlatMesh mesh;
+    SECTION("vertex index past the end") {
+        auto filepath = dir.Write("mesh.obj", std::string(kTriangle) + "f 1 2 4\n");
+        CHECK_FALSE(ObjReader::Read(filepath, mesh));
+    }
+    SECTION("relative vertex index before the start") {
+        auto filepath = dir.Write("mesh.obj", std::string(kTriangle) + "f -4 -2 -1\n");
+        CHECK_FALSE(ObjReader::Read(filepath, mesh));
+    }
+    SECTION("relative texture coordinate index resolving to -1") {
+        auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+            "vt 0 0\n"
+            "f 1/-2 2/-1 3/-1\n");
+        CHECK_FALSE(ObjReader::Read(filepath, mesh));
+    }
+    SECTION("relative normal index before the start") {
+        auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+            "vn 0 0 1\n"
+            "f 1//-3 2//-1 3//-1\n");
+        CHECK_FALSE(ObjReader::Read(filepath, mesh));
+    }
+    SECTION("no faces") {
+        auto filepath = dir.Write("mesh.obj", kTriangle);
+        CHECK_FALSE(ObjReader::Read(filepath, mesh));
+    }
+}
+
+
+TEST_CASE("ObjReader scans elements with absolute indices", "[ObjReader]")
+{
+    TempDir dir;
+    auto filepath = dir.Write("mesh.obj", std::string(kTriangle) +
+        "vn 0 0 1\n"
+        "f 1 2 3\n"
+        "v 1 1 0\n"
+        "f -4//1 -3//1 -1//1 -2//1\n");
+    RecordingVisitor visitor;
+    REQUIRE(ObjReader::Scan(filepath, visitor));
+    CHECK(visitor.positions.size() == 12);
+    REQUIRE(visitor.triangles.size() == 27);
+    const long long expected[27] = {
+        0, -1, -1,  1, -1, -1,  2, -1, -1,
+        0, -1, 0,  1, -1, 0,  3, -1, 0,
+        0, -1, 0,  3, -1, 0,  2, -1, 0 };
+    for (size_t i = 0; i < 27; ++i)
+        CHECK(visitor.triangles[i] == expected[i]);
+
+    filepath = dir.Write("mesh.obj", std::string(kTriangle) + "f -4 -2 -1\n");
+    CHECK_FALSE(ObjReader::Scan(filepath, visitor));
+}
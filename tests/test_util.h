@@ -0,0 +1,39 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <boost/filesystem.hpp>
+
+namespace RT {
+    namespace test {
+
+        // Temporary directory, removed with its contents on destruction
+        class TempDir {
+        public:
+            TempDir() {
+                path_ = boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path("rt_test_%%%%-%%%%-%%%%");
+                boost::filesystem::create_directories(path_);
+            }
+
+            ~TempDir() {
+                boost::system::error_code ec;
+                boost::filesystem::remove_all(path_, ec);
+            }
+
+            // Write contents to a file in the directory
+            // return File path
+            boost::filesystem::path Write(const std::string& filename,
+                const std::string& contents) const {
+                auto filepath = path_ / filename;
+                std::ofstream out(filepath.string(), std::ios::binary | std::ios::trunc);
+                out << contents;
+                return filepath;
+            }
+
+            inline const boost::filesystem::path& GetPath() const { return path_; }
+        private:
+            boost::filesystem::path path_;  // directory path
+        };
+
+    }  // namespace test
+}  // namespace RT
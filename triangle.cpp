@@ -86,7 +86,7 @@ namespace RT {
 
 
         bool
-            Triangle::Hit(const Ray& ray, Real tmin, Real tmax, HitRecord& hit_record)
+            Triangle::Hit(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
         {
             if (points_.size() < 3)
                 return false;
@@ -97,20 +97,21 @@ namespace RT {
                 tmin, tmax, ray_t, uv))
                 return false;
 
-            // fill hit_record
-            const Vec3r& hit_point = ray.At(ray_t);
-            hit_record.SetRayT(ray_t);
-            hit_record.SetPoint(hit_point);
-            hit_record.SetNormal(ray, normal_);
-            hit_record.SetSurface(GetPtr());
-            FaceGeoUV face_geouv = hit_record.GetFaceGeoUV();
-            face_geouv.SetFaceID(0);
-            face_geouv.SetUV(uv);
-            face_geouv.SetGlobalUV(Vec2r(-1, -1));
+            hit.Set(ray_t, this, 0, uv);
             return true;
         }
 
 
+        void
+            Triangle::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record)
+        {
+            hit_record.SetPoint(ray.At(hit.t));
+            hit_record.SetNormal(ray, normal_);
+            hit_record.SetFaceGeoUV(FaceGeoUV{ 0, hit.barycentrics, Vec2r{ -1, -1 } });
+        }
+
+
         AABB
             Triangle::GetBoundingBox(bool force_recompute)
         {
@@ -20,6 +20,9 @@ namespace RT {
                 Real& ray_t, Vec2r& uv);
 
             bool Hit(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
                 HitRecord& hit_record) override;
 
             bool SetPoints(const std::vector<Vec3r>& points);
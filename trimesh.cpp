@@ -1,10 +1,16 @@
 #include "trimesh.h"
+#include <boost/algorithm/string.hpp>
 #include <spdlog/spdlog.h>
 #include "ray.h"
 #include "material.h"
 #include "triangle.h"
 #include "face_geouv.h"
-#include "bvh_trimesh_face.h"
+#include "primitive_bvh.h"
+#include "obj_reader.h"
+#include "mesh_cache.h"
+#include "camera.h"
+#include <OpenMesh/Tools/Decimater/DecimaterT.hh>
+#include <OpenMesh/Tools/Decimater/ModQuadricT.hh>
 
 namespace RT {
     namespace core {
@@ -12,6 +18,24 @@ namespace RT {
         using namespace std;
         namespace fs = boost::filesystem;
 
+        namespace {
+
+            // Mean length of the face edges of a mesh
+            Real MeanEdgeLength(const FlatMesh& mesh)
+            {
+                if (mesh.IsEmpty())
+                    return 0;
+                Real sum = 0;
+                for (size_t f = 0; f < mesh.GetFaceCount(); ++f) {
+                    const uint* fv = mesh.GetFace(f);
+                    for (int i = 0; i < 3; ++i)
+                        sum += (mesh.GetPosition(fv[i]) - mesh.GetPosition(fv[(i + 1) % 3])).norm();
+                }
+                return sum / (3 * mesh.GetFaceCount());
+            }
+
+        }  // namespace
+
         TriMesh::TriMesh(const std::string& name) :
             OMTriMesh{},
             Surface{ name }
@@ -20,23 +44,49 @@ namespace RT {
         }
 
         bool TriMesh::Hit(const Ray& ray, Real tmin, Real tmax,
-            HitRecord& hit_record)
+            RayHit& hit)
         {
+            if (ray_lod_ && !lods_.empty())
+            {
+                size_t level = 0;
+                if (ray.GetLodSurface() == this)
+                {
+                    // rays leaving this mesh stay on the level they start on
+                    level = std::min(ray.GetLodLevel(), lods_.size());
+                }
+                else if (ray.HasCone())
+                {
+                    Real t_enter, t_exit;
+                    if (!GetBoundingBox().Hit(ray, tmin, tmax, t_enter, t_exit))
+                        return false;
+                    Real width = ray.GetConeWidth(std::max(t_enter, tmin));
+                    while (level < lods_.size() && lod_edge_lengths_[level + 1] <= width)
+                        ++level;
+                }
+                if (level > 0)
+                {
+                    if (!lods_[level - 1]->Hit(ray, tmin, tmax, hit))
+                        return false;
+                    hit.surface = this;
+                    hit.part = static_cast<uint>(level);
+                    return true;
+                }
+            }
             bool had_hit = false;
             if (bvh_ != nullptr)
             {
-                if (bvh_->Hit(ray, tmin, tmax, hit_record))
+                if (bvh_->Hit(ray, tmin, tmax, hit))
                 {
                     return true;
                 }
             }
             else
             {
-                for (auto fit = faces_begin(); fit != faces_end(); ++fit)
+                for (size_t f = 0; f < flat_.GetFaceCount(); ++f)
                 {
-                    if (RayFaceHit(*fit, ray, tmin, tmax, hit_record))
+                    if (RayFaceHit(f, ray, tmin, tmax, hit))
                     {
-                        tmax = hit_record.GetRayT();  //!< update tmax
+                        tmax = hit.t;  //!< update tmax
                         had_hit = true;
                     }
                 }
@@ -44,51 +94,115 @@ namespace RT {
             return had_hit;
         }
 
-        bool TriMesh::RayFaceHit(TriMesh::FaceHandle fh, const Ray& ray, Real tmin,
-            Real tmax, HitRecord& hit_record)
+        bool TriMesh::RayFaceHit(size_t face, const Ray& ray, Real tmin,
+            Real tmax, RayHit& hit)
         {
-
-            auto heh = halfedge_handle(fh);
-            auto vh0 = from_vertex_handle(heh);
-            auto vh1 = to_vertex_handle(heh);
-            auto vh2 = to_vertex_handle(next_halfedge_handle(heh));
-            Vec3r p0 = point(vh0);
-            Vec3r p1 = point(vh1);
-            Vec3r p2 = point(vh2);
+            const uint* fv = flat_.GetFace(face);
+            Vec3r p0 = flat_.GetPosition(fv[0]);
+            Vec3r p1 = flat_.GetPosition(fv[1]);
+            Vec3r p2 = flat_.GetPosition(fv[2]);
 
             Vec2r uvfh;
             Real ray_t;
             if (!Triangle::RayTriangleHit(p0, p1, p2,
                 ray, tmin, tmax, ray_t, uvfh)) return false;
+            hit.Set(ray_t, this, static_cast<int>(face), uvfh);
+            return true;
+        }
+
+        void TriMesh::ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+            HitRecord& hit_record)
+        {
+            if (hit.part > 0 && hit.part <= lods_.size())
+            {
+                RayHit level_hit = hit;
+                level_hit.part = 0;
+                lods_[hit.part - 1]->ComputeSurfaceInteraction(ray, level_hit, hit_record);
+                hit_record.SetLodLevel(hit.part);
+                return;
+            }
+            const int face = hit.primitive;
+            const Vec2r uvfh = hit.barycentrics;
+            const uint* fv = flat_.GetFace(static_cast<size_t>(face));
+            Real alpha = 1.0 - uvfh[0] - uvfh[1];
+            Vec3r lerp_n;
+            if (flat_.HasNormals())
+                lerp_n = alpha * flat_.GetNormal(fv[0]) + uvfh[0] * flat_.GetNormal(fv[1]) +
+                uvfh[1] * flat_.GetNormal(fv[2]);
             else
             {
-                Real alpha = 1.0 - uvfh[0] - uvfh[1];
-                Vec3r lerp_n{ alpha * normal(vh0) + uvfh[0] * normal(vh1) + uvfh[1] * normal(vh2) };
-                const Vec3r& hit_point = ray.At(ray_t);
-                hit_record.SetRayT(ray_t);
-                hit_record.SetPoint(hit_point);
-                hit_record.SetNormal(ray, lerp_n);
-                hit_record.SetSurface(GetPtr());
-                FaceGeoUV fguv;
-                fguv.SetFaceID(fh.idx());
-                fguv.SetUV(uvfh);
-                if (!has_vertex_texcoords2D())
-                {
-                    //std::cout<<"No v textcoords!"<<std::endl;
-                    fguv.SetGlobalUV(Vec2r(-1, -1));
-                }
-                else
-                {
-                    Vec2r one{ alpha * texcoord2D(vh0) };
-                    Vec2r two{ uvfh[0] * texcoord2D(vh1) };
-                    Vec2r three{ uvfh[1] * texcoord2D(vh2) };
-                    Vec2r out{ one + two + three };
-                    fguv.SetGlobalUV(out);
-                    hit_record.SetFaceGeoUV(fguv);
-                }
+                Vec3r p0 = flat_.GetPosition(fv[0]);
+                Vec3r p1 = flat_.GetPosition(fv[1]);
+                Vec3r p2 = flat_.GetPosition(fv[2]);
+                lerp_n = (p1 - p2).cross(p2 - p0).normalized();
+            }
+            hit_record.SetPoint(ray.At(hit.t));
+            hit_record.SetNormal(ray, lerp_n);
+            FaceGeoUV fguv;
+            fguv.SetFaceID(static_cast<int>(face));
+            fguv.SetUV(uvfh);
+            if (!flat_.HasTexCoords())
+            {
+                fguv.SetGlobalUV(Vec2r(-1, -1));
+            }
+            else
+            {
+                Vec2r one{ alpha * flat_.GetTexCoord(fv[0]) };
+                Vec2r two{ uvfh[0] * flat_.GetTexCoord(fv[1]) };
+                Vec2r three{ uvfh[1] * flat_.GetTexCoord(fv[2]) };
+                Vec2r out{ one + two + three };
+                fguv.SetGlobalUV(out);
+            }
+            hit_record.SetFaceGeoUV(fguv);
+        }
+
+        AABB TriMesh::GetPrimitiveBoundingBox(size_t primitive)
+        {
+            return flat_.GetFaceBoundingBox(primitive);
+        }
 
+        bool TriMesh::PrimitiveHit(size_t primitive, const Ray& ray, Real tmin, Real tmax,
+            RayHit& hit)
+        {
+            return RayFaceHit(primitive, ray, tmin, tmax, hit);
+        }
+
+        bool TriMesh::UpdateFlatMesh()
+        {
+            bool vertex_normals = has_vertex_normals();
+            bool texcoords = has_vertex_texcoords2D();
+            flat_.Resize(n_vertices(), n_faces(), vertex_normals, texcoords);
+            for (auto vit = vertices_begin(); vit != vertices_end(); ++vit)
+            {
+                auto v = static_cast<size_t>(vit->idx());
+                flat_.SetPosition(v, point(*vit));
+                if (vertex_normals)
+                    flat_.SetNormal(v, normal(*vit));
+                if (texcoords)
+                    flat_.SetTexCoord(v, texcoord2D(*vit));
             }
-            return true;
+            for (auto fit = faces_begin(); fit != faces_end(); ++fit)
+            {
+                auto heh = halfedge_handle(*fit);
+                flat_.SetFace(static_cast<size_t>(fit->idx()),
+                    static_cast<uint>(from_vertex_handle(heh).idx()),
+                    static_cast<uint>(to_vertex_handle(heh).idx()),
+                    static_cast<uint>(to_vertex_handle(next_halfedge_handle(heh)).idx()));
+            }
+            bound_dirty_ = true;
+            return !flat_.IsEmpty();
+        }
+
+        void TriMesh::ReleaseOpenMesh()
+        {
+            if (!n_vertices())
+                return;
+            release_face_normals();
+            release_vertex_normals();
+            release_vertex_texcoords2D();
+            clean();
+            spdlog::info("Released OpenMesh data of {} (flat mesh: {} KB)", GetName(),
+                flat_.GetMemory() / 1024);
         }
 
         bool TriMesh::ComputeFaceNormals()
@@ -115,10 +229,28 @@ namespace RT {
         {
             request_vertex_normals();
             if (!has_vertex_normals()) return false;
+            // scatter face normals to their vertices in one pass over the
+            // faces instead of circulating the faces around each vertex
+            std::vector<Vec3r> sums(n_vertices(), Vec3r{ 0,0,0 });
+            for (auto fit = faces_begin(); fit != faces_end(); ++fit)
+            {
+                auto heh = halfedge_handle(*fit);
+                auto vh0 = from_vertex_handle(heh);
+                auto vh1 = to_vertex_handle(heh);
+                auto vh2 = to_vertex_handle(next_halfedge_handle(heh));
+                Vec3r normal = (point(vh1) - point(vh2)).cross(point(vh2) - point(vh0));
+                Real length = normal.norm();
+                if (!(length > 0)) continue;
+                normal /= length;
+                sums[vh0.idx()] += normal;
+                sums[vh1.idx()] += normal;
+                sums[vh2.idx()] += normal;
+            }
             for (auto vit = vertices_begin(); vit != vertices_end(); ++vit)
             {
-                Vec3r vertex_normal = VertexNormal(*vit);
-                set_normal(*vit, vertex_normal);
+                Vec3r& sum = sums[vit->idx()];
+                Real length = sum.norm();
+                set_normal(*vit, length > 0 ? Vec3r(sum / length) : sum);
             }
             return true;
         }
@@ -136,36 +268,65 @@ namespace RT {
             return face_normals;
         }
 
-        bool TriMesh::Load(const boost::filesystem::path& filepath)
+        bool TriMesh::Load(const boost::filesystem::path& filepath, bool reorder,
+            bool use_cache)
         {
-
-            request_face_normals();
-            request_vertex_normals();
-            request_vertex_texcoords2D();
-            OpenMesh::IO::Options opts{ OpenMesh::IO::Options::FaceNormal |
-                                       OpenMesh::IO::Options::VertexNormal |
-                                      OpenMesh::IO::Options::VertexTexCoord };
-            std::string filename = filepath.string();
-            if (!OpenMesh::IO::read_mesh(*this, filename, opts))
-            {
-                spdlog::error("could not load mesh from { }", filepath.string());
-                return false;
+            filepath_ = filepath;
+            if (use_cache && MeshCache::Load(filepath, reorder, flat_, bbox_))
+            {
+                bound_dirty_ = false;
+                return true;
+            }
+            std::string extension = boost::algorithm::to_lower_copy(filepath.extension().string());
+            if (extension == ".obj")
+            {
+                // fast path: parse OBJ files directly into the flat mesh
+                if (!ObjReader::Read(filepath, flat_))
+                {
+                    spdlog::error("could not load mesh from {}", filepath.string());
+                    return false;
+                }
             }
-            if (!opts.check(OpenMesh::IO::Options::FaceNormal))
-                ComputeFaceNormals();
-            if (!opts.check(OpenMesh::IO::Options::VertexNormal))
-                ComputeVertexNormals();
-            // delete vertex texcoord2d attribute if file did not have them
-            if (opts.check(OpenMesh::IO::Options::VertexTexCoord))
-                spdlog::info("mesh has texture coordinates");
             else
             {
-                std::cout << "Mesh does not have texture coordinates" << std::endl;
-                release_vertex_texcoords2D();
+                request_vertex_normals();
+                request_vertex_texcoords2D();
+                OpenMesh::IO::Options opts{ OpenMesh::IO::Options::VertexNormal |
+                                          OpenMesh::IO::Options::VertexTexCoord };
+                if (!OpenMesh::IO::read_mesh(*this, filepath.string(), opts))
+                {
+                    spdlog::error("could not load mesh from {}", filepath.string());
+                    return false;
+                }
+                // drop attributes the file did not have
+                if (!opts.check(OpenMesh::IO::Options::VertexNormal))
+                    release_vertex_normals();
+                if (!opts.check(OpenMesh::IO::Options::VertexTexCoord))
+                    release_vertex_texcoords2D();
+                UpdateFlatMesh();
+                ReleaseOpenMesh();
             }
+            if (flat_.HasTexCoords())
+                spdlog::info("mesh has texture coordinates");
+            // reorder first, so the normal pass sees narrow vertex ranges
+            if (reorder)
+                ReorderForLocality();
+            if (!flat_.HasNormals())
+                flat_.ComputeVertexNormals();
+            bound_dirty_ = true;
+            if (flat_.IsEmpty())
+                return false;
+            if (use_cache)
+                MeshCache::Save(filepath, reorder, flat_);
             return true;
         }
 
+        bool TriMesh::ReorderForLocality()
+        {
+            bound_dirty_ = true;
+            return flat_.ReorderForLocality();
+        }
+
         bool TriMesh::Save(const boost::filesystem::path& filepath,
             OpenMesh::IO::Options opts)
         {
@@ -185,28 +346,168 @@ namespace RT {
             if (!force_recompute && !IsBoundDirty())
                 return bbox_;
 
-            // compute triangle bbox
-            bbox_.Reset();
-            for (auto vit = vertices_begin(); vit != vertices_end(); ++vit)
-            {
-                bbox_.ExpandBy(point(*vit));
-            }
+            // compute mesh bbox
+            bbox_ = flat_.GetBoundingBox();
             bound_dirty_ = false;
             return bbox_;
         }
 
         void TriMesh::BuildBVH()
         {
-            auto bvh_root = BVHNode::Create();
-            std::vector<Surface::Ptr> bvh_faces(n_faces());
-            int i = 0;
-            for (auto fit = faces_begin(); fit != faces_end(); ++fit)
+            if (flat_.IsEmpty())
+                UpdateFlatMesh();
+            std::vector<PrimitiveRef> faces(flat_.GetFaceCount());
+            for (size_t f = 0; f < faces.size(); ++f)
+                faces[f] = PrimitiveRef{ this, static_cast<int>(f) };
+
+            // the tree references this mesh, so it must not own it
+            auto bvh = PrimitiveBVH::Create(GetName());
+            if (bvh->Build(std::move(faces), std::vector<Surface::Ptr>()))
+                bvh_ = bvh;
+
+            // rendering only needs the flat mesh from here on
+            ReleaseOpenMesh();
+        }
+
+        size_t TriMesh::BuildLods(size_t max_levels, size_t min_faces)
+        {
+            lods_.clear();
+            lod_edge_lengths_.assign(1, MeanEdgeLength(flat_));
+            const size_t face_count = flat_.GetFaceCount();
+            if (!max_levels || face_count / 4 < min_faces)
+                return 0;
+
+            // decimate a temporary OpenMesh copy of the flat mesh; halfedge
+            // collapses keep the surviving vertices and their texcoords
+            OMTriMesh mesh;
+            const bool texcoords = flat_.HasTexCoords();
+            if (texcoords)
+                mesh.request_vertex_texcoords2D();
+            mesh.reserve(flat_.GetVertexCount(), 3 * face_count / 2, face_count);
+            std::vector<OMTriMesh::VertexHandle> handles(flat_.GetVertexCount());
+            for (size_t v = 0; v < handles.size(); ++v)
+            {
+                handles[v] = mesh.add_vertex(flat_.GetPosition(v));
+                if (texcoords)
+                    mesh.set_texcoord2D(handles[v], flat_.GetTexCoord(v));
+            }
+            size_t skipped = 0;
+            for (size_t f = 0; f < face_count; ++f)
+            {
+                const uint* fv = flat_.GetFace(f);
+                if (!mesh.add_face(handles[fv[0]], handles[fv[1]], handles[fv[2]]).is_valid())
+                    ++skipped;
+            }
+            if (skipped)
+                spdlog::warn("TriMesh: {} complex face(s) of {} left out of its levels of detail",
+                    skipped, GetName());
+            mesh.request_vertex_status();
+            mesh.request_edge_status();
+            mesh.request_face_status();
+
+            using Decimater = OpenMesh::Decimater::DecimaterT<OMTriMesh>;
+            using ModQuadric = OpenMesh::Decimater::ModQuadricT<OMTriMesh>;
+            Decimater decimater(mesh);
+            ModQuadric::Handle quadric;
+            decimater.add(quadric);
+            decimater.module(quadric).unset_max_err();
+            if (!decimater.initialize())
+            {
+                spdlog::error("TriMesh: cannot decimate {}", GetName());
+                return 0;
+            }
+
+            size_t previous_faces = face_count;
+            for (size_t level = 1; level <= max_levels; ++level)
+            {
+                const size_t target = face_count >> (2 * level);
+                if (target < min_faces)
+                    break;
+                decimater.decimate_to_faces(0, target);
+
+                // gather the remaining faces, renumbering their vertices
+                std::vector<uint> remap(mesh.n_vertices(), ~0u);
+                std::vector<OMTriMesh::VertexHandle> vertices;
+                std::vector<uint> indices;
+                for (auto fh : mesh.faces())
+                {
+                    for (auto vh : mesh.fv_range(fh))
+                    {
+                        uint& index = remap[vh.idx()];
+                        if (index == ~0u)
+                        {
+                            index = static_cast<uint>(vertices.size());
+                            vertices.push_back(vh);
+                        }
+                        indices.push_back(index);
+                    }
+                }
+                const size_t lod_faces = indices.size() / 3;
+                if (!lod_faces || lod_faces >= previous_faces)
+                    break;  // decimation stalled
+                previous_faces = lod_faces;
+
+                FlatMesh flat;
+                flat.Resize(vertices.size(), lod_faces, false, texcoords);
+                for (size_t v = 0; v < vertices.size(); ++v)
+                {
+                    flat.SetPosition(v, mesh.point(vertices[v]));
+                    if (texcoords)
+                        flat.SetTexCoord(v, mesh.texcoord2D(vertices[v]));
+                }
+                std::copy(indices.begin(), indices.end(), flat.GetIndexData());
+                flat.ReorderForLocality();
+                flat.ComputeVertexNormals();
+                if (flat_.IsQuantized())
+                    flat.Quantize();
+
+                auto lod = TriMesh::Create(GetName() + "_lod" + std::to_string(level));
+                lod->filepath_ = filepath_;
+                lod->SetFlatMesh(std::move(flat));
+                lod_edge_lengths_.push_back(MeanEdgeLength(lod->flat_));
+                lods_.push_back(lod);
+            }
+            spdlog::info("TriMesh: built {} level(s) of detail for {} ({} -> {} faces)",
+                lods_.size(), GetName(), face_count, previous_faces);
+            return lods_.size();
+        }
+
+        size_t TriMesh::SelectLod(const Camera& camera, uint image_height,
+            Real faces_per_pixel)
+        {
+            size_t level = 0;
+            AABB bbox = GetBoundingBox();
+            Vec3r center = (bbox.GetMin() + bbox.GetMax()) / 2;
+            Real radius = (bbox.GetMax() - bbox.GetMin()).norm() / 2;
+            Real distance = (center - camera.GetEye()).norm();
+            Real pixel_spread = camera.GetPixelSpread(image_height);
+            if (!lods_.empty() && distance > radius && pixel_spread > 0)
+            {
+                // pixels covered by the bounding sphere's projection
+                Real pixel_radius = radius / distance / pixel_spread;
+                Real target = M_PI * pixel_radius * pixel_radius * faces_per_pixel;
+                while (level < lods_.size() &&
+                    static_cast<Real>(lods_[level]->flat_.GetFaceCount()) >= target)
+                    ++level;
+            }
+            if (level > 0)
             {
-                auto fptr = BVHTriMeshFace::Create(GetPtr(), *fit);
-                bvh_faces[i] = fptr;
-                ++i;
+                spdlog::info("TriMesh: rendering {} at level {} ({} of {} faces)", GetName(),
+                    level, lods_[level - 1]->flat_.GetFaceCount(), flat_.GetFaceCount());
+                // the level may be shared with other meshes (\see ShareLods)
+                SetFlatMesh(lods_[level - 1]->flat_.Share());
             }
-            bvh_ = bvh_root->BuildBVH(bvh_faces);
+            lods_.clear();
+            lod_edge_lengths_.clear();
+            return level;
+        }
+
+        void TriMesh::EnableRayLod()
+        {
+            for (auto& lod : lods_)
+                if (!lod->HasBVH())
+                    lod->BuildBVH();
+            ray_lod_ = !lods_.empty();
         }
 
     }  // namespace core
@@ -2,6 +2,7 @@
 #define _USE_MATH_DEFINES
 #include <memory>
 #include <string>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <OpenMesh/Core/IO/MeshIO.hh>
 #include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
@@ -11,11 +12,11 @@
 #include <eigen-3.4.0/Eigen/Dense>
 #include <eigen-3.4.0/Eigen/Geometry>
 #include "surface.h"
-#include "bvh_node.h"
+#include "flat_mesh.h"
 
 namespace RT {
     namespace core {
-        class BVHNode;
+        class Camera;
 
         // use Eigen instead of OpenMesh's default structures for Point and
         // Normal
@@ -27,6 +28,10 @@ namespace RT {
         };
         using OMTriMesh = OpenMesh::TriMesh_ArrayKernelT<EigenMeshTraits>;
 
+        // Triangle mesh. Meshes are stored in a compact \see FlatMesh used
+        // for rendering. OBJ files are read directly into it with the
+        // parallel \see ObjReader; other formats are read with OpenMesh,
+        // converted, and the OpenMesh structure is released.
         class TriMesh : public OMTriMesh, public Surface {
         public:
             RT_NODE(TriMesh)
@@ -34,18 +39,48 @@ namespace RT {
                 explicit TriMesh(const std::string& name = std::string());
 
             bool Hit(const Ray& ray, Real tmin, Real tmax,
-                HitRecord& hit_record) override;
+                RayHit& hit) override;
+
+            // Intersect ray with face (index into the flat mesh)
+            bool RayFaceHit(size_t face, const Ray& ray, Real tmin,
+                Real tmax, RayHit& hit);
 
-            bool RayFaceHit(TriMesh::FaceHandle fh, const Ray& ray, Real tmin,
-                Real tmax, HitRecord& hit_record);
+            // Interpolate normal and texture coordinates at a face hit
+            // Hits on a coarser level (\see RayHit::part) are computed by
+            // that level's mesh
+            void ComputeSurfaceInteraction(const Ray& ray, const RayHit& hit,
+                HitRecord& hit_record) override;
 
-            bool Load(const boost::filesystem::path& filepath);
+            // Load mesh from file. If reorder is set, faces and vertices are
+            // reordered for memory locality after loading
+            // (\see ReorderForLocality). If use_cache is set, an up-to-date
+            // \see MeshCache file is mapped instead of reading the mesh, and
+            // one is written after reading it.
+            bool Load(const boost::filesystem::path& filepath, bool reorder = true,
+                bool use_cache = true);
 
             bool Save(const boost::filesystem::path& filepath,
                 OpenMesh::IO::Options opts = OpenMesh::IO::Options::Default);
 
             AABB GetBoundingBox(bool force_recompute = false) override;
 
+            // with per-ray LOD the mesh chooses its level itself, so it is
+            // not flattened into an enclosing BVH
+            size_t GetPrimitiveCount() const override {
+                return ray_lod_ ? 1 : flat_.GetFaceCount();
+            }
+
+            // meshes sharing a flat mesh (\see ShareGeometry) view the same
+            // index array
+            const void* GetGeometryKey() const override {
+                return flat_.GetFaceCount() ? flat_.GetFace(0) : Surface::GetGeometryKey();
+            }
+
+            AABB GetPrimitiveBoundingBox(size_t primitive) override;
+
+            bool PrimitiveHit(size_t primitive, const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
             bool ComputeFaceNormals();
 
             bool ComputeVertexNormals();
@@ -59,10 +94,97 @@ namespace RT {
 
             Vec3r VertexNormal(TriMesh::VertexHandle fh, bool normalize = true);
 
+            // Reorder the flat mesh for memory locality
+            // (\see FlatMesh::ReorderForLocality). Must be called before
+            // the BVH is built.
+            bool ReorderForLocality();
+
+            // Build the mesh BVH over its faces (a \see PrimitiveBVH whose
+            // leaves are face indices)
             void BuildBVH();
+
+            // Return whether the mesh BVH has been built
+            bool HasBVH() const { return bvh_ != nullptr; }
+
+            // Convert the OpenMesh data into the flat render-time mesh. Must
+            // be called again after editing the mesh through OpenMesh.
+            bool UpdateFlatMesh();
+
+            // Release the OpenMesh connectivity and properties; afterwards
+            // only the flat mesh is available (e.g. Save writes nothing)
+            void ReleaseOpenMesh();
+
+            // Quantize the flat mesh's vertex attributes to save memory
+            // (\see FlatMesh::Quantize); positions move by up to half a
+            // quantization step, about 1/131070 of the mesh extent
+            void Quantize()
+            {
+                flat_.Quantize();
+                bvh_ = nullptr;
+                bound_dirty_ = true;
+            }
+
+            // Get render-time mesh
+            inline const FlatMesh& GetFlatMesh() const { return flat_; }
+
+            // Use the flat mesh of source (read-only) instead of a copy
+            // (\see FlatMesh::Share); either mesh may later replace its
+            // geometry without affecting the other
+            void ShareGeometry(const TriMesh::Ptr& source)
+            {
+                SetFlatMesh(source->flat_.Share());
+                filepath_ = source->filepath_;
+            }
+
+            // Replace the mesh geometry with a flat mesh (the OpenMesh data
+            // is not updated)
+            void SetFlatMesh(FlatMesh flat)
+            {
+                flat_ = std::move(flat);
+                bvh_ = nullptr;
+                bound_dirty_ = true;
+            }
+
+            // Build coarser levels of detail by quadric edge collapse (OpenMesh
+            // Decimater), each with about a quarter of the faces of the
+            // previous level, until a level would have fewer than min_faces
+            // return Number of levels built (besides the full mesh)
+            size_t BuildLods(size_t max_levels = kMaxLodLevels,
+                size_t min_faces = kMinLodFaces);
+
+            // Use the levels of detail built by source, which must share this
+            // mesh's geometry (the levels are read-only and shared too)
+            void ShareLods(const TriMesh& source)
+            {
+                lods_ = source.lods_;
+                lod_edge_lengths_ = source.lod_edge_lengths_;
+            }
+
+            // Get number of levels of detail, including the full mesh
+            inline size_t GetLodCount() const { return lods_.size() + 1; }
+
+            // Render the coarsest level that still has faces_per_pixel faces
+            // per pixel the mesh covers in an image of image_height rows seen
+            // from camera, and release the other levels
+            // return Selected level (0 is the full mesh)
+            size_t SelectLod(const Camera& camera, uint image_height,
+                Real faces_per_pixel = kLodFacesPerPixel);
+
+            // Keep all levels and choose one per ray: the coarsest level
+            // whose mean edge length is within the ray cone's width where it
+            // enters the mesh bounds. Rays without a cone use the full mesh.
+            void EnableRayLod();
+
+            static constexpr size_t kMaxLodLevels = 4;       // levels below the full mesh
+            static constexpr size_t kMinLodFaces = 256;      // smallest level
+            static constexpr Real kLodFacesPerPixel = 2;     // instance LOD density
         protected:
             boost::filesystem::path filepath_;
-            BVHNode::Ptr bvh_{ nullptr };
+            Surface::Ptr bvh_{ nullptr };
+            FlatMesh flat_;  // render-time mesh
+            std::vector<TriMesh::Ptr> lods_;      // levels 1.. (coarser), each with own BVH
+            std::vector<Real> lod_edge_lengths_;  // mean edge length per level (0 is full)
+            bool ray_lod_{ false };               // whether Hit chooses a level per ray
         };
 
 
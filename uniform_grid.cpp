@@ -0,0 +1,174 @@
+#include "uniform_grid.h"
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include "ray.h"
+
+namespace RT {
+    namespace core {
+
+        using namespace std;
+
+        UniformGrid::UniformGrid(const std::string& name) :
+            Accelerator{}
+        {
+            name_ = name.size() ? name : "UniformGrid";
+        }
+
+
+        Vec3i
+            UniformGrid::PointToCell(const Vec3r& point) const
+        {
+            Vec3i cell;
+            const Vec3r& bmin = bbox_.GetMin();
+            for (int i = 0; i < 3; ++i) {
+                auto c = static_cast<int>(floor((point[i] - bmin[i]) / cell_size_[i]));
+                cell[i] = CLAMP(c, 0, resolution_[i] - 1);
+            }
+            return cell;
+        }
+
+
+        bool
+            UniformGrid::BuildBounded(const std::vector<Surface::Ptr>& surfaces)
+        {
+            BuildMeshBVHs(surfaces);
+            surfaces_.clear();
+            cell_start_.clear();
+            cell_surfaces_.clear();
+            bbox_.Reset();
+            bound_dirty_ = false;
+
+            vector<AABB> boxes;
+            for (const auto& surface : surfaces) {
+                if (!surface)
+                    continue;
+                AABB box = surface->GetBoundingBox();
+                if (!box.IsValid())
+                    continue;
+                surfaces_.push_back(surface);
+                boxes.push_back(box);
+                bbox_.ExpandBy(box);
+            }
+            if (surfaces_.empty())
+                return false;
+
+            // choose resolution so that there are ~density_ cells per surface,
+            // with cells as close to cubes as the scene extent allows
+            const Vec3r& extent = bbox_.GetMax() - bbox_.GetMin();
+            Real max_extent = extent.maxCoeff();
+            Real cells_per_axis = cbrt(density_ * static_cast<Real>(surfaces_.size()));
+            for (int i = 0; i < 3; ++i) {
+                int res = max_extent > 0 ?
+                    static_cast<int>(round(extent[i] / max_extent * cells_per_axis)) : 1;
+                resolution_[i] = CLAMP(res, 1, kMaxResolution);
+                cell_size_[i] = extent[i] > 0 ? extent[i] / resolution_[i] : 1;
+            }
+            size_t cell_count = static_cast<size_t>(resolution_[0]) * resolution_[1] *
+                resolution_[2];
+
+            // count, then fill, the surfaces overlapping each cell
+            cell_start_.assign(cell_count + 1, 0);
+            for (int pass = 0; pass < 2; ++pass) {
+                vector<uint> cell_fill;
+                if (pass == 1) {
+                    for (size_t c = 0; c < cell_count; ++c)
+                        cell_start_[c + 1] += cell_start_[c];
+                    cell_surfaces_.resize(cell_start_[cell_count]);
+                    cell_fill.assign(cell_start_.begin(), cell_start_.end() - 1);
+                }
+                for (size_t s = 0; s < surfaces_.size(); ++s) {
+                    Vec3i lo = PointToCell(boxes[s].GetMin());
+                    Vec3i hi = PointToCell(boxes[s].GetMax());
+                    for (int z = lo[2]; z <= hi[2]; ++z) {
+                        for (int y = lo[1]; y <= hi[1]; ++y) {
+                            for (int x = lo[0]; x <= hi[0]; ++x) {
+                                auto c = CellIndex(x, y, z);
+                                if (pass == 0)
+                                    ++cell_start_[c + 1];
+                                else
+                                    cell_surfaces_[cell_fill[c]++] = static_cast<uint>(s);
+                            }
+                        }
+                    }
+                }
+            }
+
+            spdlog::info("Built uniform grid ({}x{}x{} cells, {} references)",
+                resolution_[0], resolution_[1], resolution_[2], cell_surfaces_.size());
+            return true;
+        }
+
+
+        bool
+            UniformGrid::HitBounded(const Ray& ray, Real tmin, Real tmax, RayHit& hit)
+        {
+            Real t_enter, t_exit;
+            if (surfaces_.empty() || !bbox_.Hit(ray, tmin, tmax, t_enter, t_exit))
+                return false;
+
+            // set up the 3D-DDA: t_next is the ray t at which the next cell
+            // boundary is crossed along each axis, t_delta the t spacing
+            // between boundaries
+            const Vec3r& dir = ray.GetDirection();
+            const Vec3r& entry = ray.At(t_enter);
+            const Vec3r& bmin = bbox_.GetMin();
+            Vec3i cell = PointToCell(entry);
+            Vec3r t_next, t_delta;
+            int step[3], out[3];
+            for (int i = 0; i < 3; ++i) {
+                if (dir[i] > 0) {
+                    Real boundary = bmin[i] + (cell[i] + 1) * cell_size_[i];
+                    t_next[i] = t_enter + (boundary - entry[i]) / dir[i];
+                    t_delta[i] = cell_size_[i] / dir[i];
+                    step[i] = 1;
+                    out[i] = resolution_[i];
+                }
+                else if (dir[i] < 0) {
+                    Real boundary = bmin[i] + cell[i] * cell_size_[i];
+                    t_next[i] = t_enter + (boundary - entry[i]) / dir[i];
+                    t_delta[i] = -cell_size_[i] / dir[i];
+                    step[i] = -1;
+                    out[i] = -1;
+                }
+                else {
+                    t_next[i] = kInfinity;
+                    t_delta[i] = kInfinity;
+                    step[i] = 0;
+                    out[i] = -1;
+                }
+            }
+
+            bool had_hit = false;
+            Real closest = tmax;
+            SurfaceMailbox mailbox;  // surfaces spanning several cells are tested once
+            for (;;) {
+                // intersect surfaces in the current cell
+                auto c = CellIndex(cell[0], cell[1], cell[2]);
+                for (auto i = cell_start_[c]; i < cell_start_[c + 1]; ++i) {
+                    if (mailbox.Contains(cell_surfaces_[i]))
+                        continue;
+                    if (surfaces_[cell_surfaces_[i]]->Hit(ray, tmin, closest, hit)) {
+                        closest = hit.t;
+                        had_hit = true;
+                    }
+                }
+
+                // step to the neighboring cell along the axis whose boundary
+                // comes first; a hit before that boundary cannot be beaten
+                int axis = 0;
+                if (t_next[1] < t_next[axis])
+                    axis = 1;
+                if (t_next[2] < t_next[axis])
+                    axis = 2;
+                if (closest <= t_next[axis] || t_next[axis] > t_exit)
+                    break;
+                cell[axis] += step[axis];
+                if (cell[axis] == out[axis])
+                    break;
+                t_next[axis] += t_delta[axis];
+            }
+            return had_hit;
+        }
+
+    }  // namespace core
+}  // namespace RT
@@ -0,0 +1,56 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "accelerator.h"
+
+namespace RT {
+    namespace core {
+
+        class Ray;
+        struct RayHit;
+
+        // Uniform grid accelerator. Surfaces are binned into equally sized
+        // cells (by their bounding boxes) and rays walk the cells front to
+        // back with a 3D-DDA, stopping at the first cell that contains the
+        // closest hit. Works best for dense scenes of similarly sized surfaces.
+        // Surfaces spanning several cells are mailboxed (\see SurfaceMailbox).
+        class UniformGrid : public Accelerator {
+        public:
+            RT_NODE(UniformGrid)
+
+                explicit UniformGrid(const std::string& name = std::string());
+
+            // Set the target number of cells per surface
+            inline void SetDensity(Real density) { density_ = density; }
+
+            inline Real GetDensity() const { return density_; }
+
+            // Get grid resolution (number of cells along each axis)
+            inline Vec3i GetResolution() const { return resolution_; }
+
+            static constexpr int kMaxResolution = 512;  // max cells along an axis
+        protected:
+            bool BuildBounded(const std::vector<Surface::Ptr>& surfaces) override;
+
+            bool HitBounded(const Ray& ray, Real tmin, Real tmax,
+                RayHit& hit) override;
+
+            // Get index of cell (x, y, z) in cell_start_
+            inline size_t CellIndex(int x, int y, int z) const {
+                return (static_cast<size_t>(z) * resolution_[1] + y) * resolution_[0] + x;
+            }
+
+            // Get cell coordinates of a point (clamped to the grid)
+            Vec3i PointToCell(const Vec3r& point) const;
+
+            std::vector<Surface::Ptr> surfaces_;   // gridded surfaces
+            std::vector<uint> cell_start_;         // per-cell offset into cell_surfaces_ (+1 end)
+            std::vector<uint> cell_surfaces_;      // surface indices, grouped by cell
+            Vec3i resolution_{ 0, 0, 0 };          // number of cells along each axis
+            Vec3r cell_size_{ 0, 0, 0 };           // cell extent along each axis
+            Real density_{ 2 };                    // cells per surface
+        };
+
+    }  // namespace core
+}  // namespace RT